@@ -26,6 +26,7 @@
 #include "parlay/random.h"
 #include "clusterEdge.h"
 #include "../utils/graph.h"
+#include "../utils/blocked_distances.h"
 #include <random>
 #include <set>
 #include <math.h>
@@ -141,28 +142,32 @@ struct hcnng_index{
 		size_t m = 10;
 		auto less = [&] (labelled_edge a, labelled_edge b) {return a.second < b.second;};
 		parlay::sequence<parlay::sequence<labelled_edge>> pre_labelled(N);
-		parlay::parallel_for(0, N, [&] (size_t i){
-			std::priority_queue<labelled_edge, std::vector<labelled_edge>, decltype(less)> Q(less);
-			for(indexType j=0; j<N; j++){
-				if(j!=i){
-					distanceType dist_ij = Points[active_indices[i]].distance(Points[active_indices[j]]);
-					if(Q.size() >= m){
-						distanceType topdist = Q.top().second;
-						if(dist_ij < topdist){
-							labelled_edge e;
-							if(i<j) e = std::make_pair(std::make_pair(i,j), dist_ij);
-							else e = std::make_pair(std::make_pair(j, i), dist_ij);
-							Q.pop();
-							Q.push(e);
-						}
-					}else{
+		using edge_queue = std::priority_queue<labelled_edge, std::vector<labelled_edge>, decltype(less)>;
+		parlay::sequence<edge_queue> queues(N, edge_queue(less));
+		auto point = [&] (size_t i) {return Points[active_indices[i]];};
+		//all pairs distances, computed in tiles so the points stay in cache
+		blocked_distances(N, point, N, point, [&] (size_t i, size_t j, distanceType dist_ij){
+			edge_queue &Q = queues[i];
+			if(j!=i){
+				if(Q.size() >= m){
+					distanceType topdist = Q.top().second;
+					if(dist_ij < topdist){
 						labelled_edge e;
 						if(i<j) e = std::make_pair(std::make_pair(i,j), dist_ij);
 						else e = std::make_pair(std::make_pair(j, i), dist_ij);
+						Q.pop();
 						Q.push(e);
 					}
+				}else{
+					labelled_edge e;
+					if(i<j) e = std::make_pair(std::make_pair(i,j), dist_ij);
+					else e = std::make_pair(std::make_pair(j, i), dist_ij);
+					Q.push(e);
 				}
 			}
+		});
+		parlay::parallel_for(0, N, [&] (size_t i){
+			edge_queue &Q = queues[i];
 			indexType limit = std::min(Q.size(), m);
 			parlay::sequence<labelled_edge> edges(limit);
 			for(indexType j=0; j<limit; j++){edges[j] = Q.top(); Q.pop();}
@@ -224,6 +224,10 @@ public:
 		decltype(auto) num_nodes() const{
 			return hnsw.get().n;
 		}
+		// the range of node ids, which sizes the visited table of beam_search
+		size_t size() const{
+			return hnsw.get().node_pool.size();
+		}
 		decltype(auto) get_node(node_id pu) const{
 			return hnsw.get().get_node(pu);
 		}
@@ -9,6 +9,8 @@
 #include <x86intrin.h>
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <type_traits>
 
@@ -21,224 +23,735 @@ namespace efanna2e {
 // atomic_sum_counter<size_t> distance_calls;
 
 enum Metric { L2 = 0, INNER_PRODUCT = 1, FAST_L2 = 2, PQ = 3 };
-class Distance {
- public:
-  virtual float compare(const float *a, const float *b,
-                        unsigned length) const = 0;
-  virtual ~Distance() {}
+
+// SIMD level of the machine we are running on.  Each kernel family below
+// is resolved from it once at startup, so a single binary can run on hosts
+// with and without AVX-512 regardless of the -march flags it was built with.
+enum SimdLevel {
+  SIMD_SCALAR = 0, SIMD_SSE = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3
 };
 
-class DistanceL2 : public Distance {
- public:
-  float compare(const float *a, const float *b, unsigned size) const {
-    float result = 0;
+inline SimdLevel detect_simd_level() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2")) return SIMD_SSE;
+  return SIMD_SCALAR;
+}
 
-#ifdef __GNUC__
-#ifdef __AVX__
+// picks the kernel matching the SIMD level out of a family of kernels
+template<typename Kernel>
+Kernel select_kernel(Kernel avx512, Kernel avx2, Kernel sse, Kernel scalar) {
+  switch (detect_simd_level()) {
+    case SIMD_AVX512:
+      return avx512;
+    case SIMD_AVX2:
+      return avx2;
+    case SIMD_SSE:
+      return sse;
+    default:
+      return scalar;
+  }
+}
 
-#define AVX_L2SQR(addr1, addr2, dest, tmp1, tmp2) \
-  tmp1 = _mm256_loadu_ps(addr1);                  \
-  tmp2 = _mm256_loadu_ps(addr2);                  \
-  tmp1 = _mm256_sub_ps(tmp1, tmp2);               \
-  tmp1 = _mm256_mul_ps(tmp1, tmp1);               \
-  dest = _mm256_add_ps(dest, tmp1);
+inline float l2_sqr_scalar(const float *a, const float *b, unsigned size) {
+  float result = 0;
+  float diff0, diff1, diff2, diff3;
+  const float *last = a + size;
+  const float *unroll_group = last - 3;
+
+  /* Process 4 items with each loop for efficiency. */
+  while (a < unroll_group) {
+    diff0 = a[0] - b[0];
+    diff1 = a[1] - b[1];
+    diff2 = a[2] - b[2];
+    diff3 = a[3] - b[3];
+    result += diff0 * diff0 + diff1 * diff1 + diff2 * diff2 + diff3 * diff3;
+    a += 4;
+    b += 4;
+  }
+  /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
+  while (a < last) {
+    diff0 = *a++ - *b++;
+    result += diff0 * diff0;
+  }
+  return result;
+}
 
-    __m256 sum;
-    __m256 l0, l1;
-    __m256 r0, r1;
-    size_t qty16 = size >> 4;
-    size_t aligned_size = qty16 << 4;
-    const float *l = a;
-    const float *r = b;
+inline float l2_sqr_sse(const float *a, const float *b, unsigned size) {
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  unsigned i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+  }
+  float unpack[4] __attribute__((aligned(16)));
+  _mm_store_ps(unpack, _mm_add_ps(sum0, sum1));
+  float result = unpack[0] + unpack[1] + unpack[2] + unpack[3];
+  for (; i < size; i++) {
+    float diff = a[i] - b[i];
+    result += diff * diff;
+  }
+  return result;
+}
 
-    float unpack[8] __attribute__((aligned(32))) = {0, 0, 0, 0, 0, 0, 0, 0};
-    sum = _mm256_loadu_ps(unpack);
+__attribute__((target("avx2,fma")))
+inline float l2_sqr_avx2(const float *a, const float *b, unsigned size) {
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+    __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+    __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+    sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+    sum1 = _mm256_fmadd_ps(d1, d1, sum1);
+    sum2 = _mm256_fmadd_ps(d2, d2, sum2);
+    sum3 = _mm256_fmadd_ps(d3, d3, sum3);
+  }
+  for (; i + 8 <= size; i += 8) {
+    __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+  }
+  __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_movehdup_ps(half));
+  float result = _mm_cvtss_f32(half);
+  for (; i < size; i++) {
+    float diff = a[i] - b[i];
+    result += diff * diff;
+  }
+  return result;
+}
 
-    for (unsigned i = 0; i < aligned_size; i += 16, l += 16, r += 16) {
-      AVX_L2SQR(l, r, sum, l0, r0);
-      AVX_L2SQR(l + 8, r + 8, sum, l1, r1);
-    }
-    _mm256_storeu_ps(unpack, sum);
-    result = unpack[0] + unpack[1] + unpack[2] + unpack[3] + unpack[4] + unpack[5] + unpack[6] + unpack[7];
-    for (unsigned i = aligned_size; i < size; ++i, ++l, ++r) {
-      float diff = *l - *r;
-      result += diff * diff;
-    }
-    
-    /*
-#else
-#ifdef __SSE2__
-#define SSE_L2SQR(addr1, addr2, dest, tmp1, tmp2) \
-        tmp1 = _mm_load_ps(addr1);\
-        tmp2 = _mm_load_ps(addr2);\
-        tmp1 = _mm_sub_ps(tmp1, tmp2); \
-        tmp1 = _mm_mul_ps(tmp1, tmp1); \
-        dest = _mm_add_ps(dest, tmp1);
-
-__m128 sum;
-__m128 l0, l1, l2, l3;
-__m128 r0, r1, r2, r3;
-unsigned D = (size + 3) & ~3U;
-unsigned DR = D % 16;
-unsigned DD = D - DR;
-const float *l = a;
-const float *r = b;
-const float *e_l = l + DD;
-const float *e_r = r + DD;
-float unpack[4] __attribute__ ((aligned (16))) = {0, 0, 0, 0};
-
-sum = _mm_load_ps(unpack);
-switch (DR) {
-    case 12:
-    SSE_L2SQR(e_l+8, e_r+8, sum, l2, r2);
-    case 8:
-    SSE_L2SQR(e_l+4, e_r+4, sum, l1, r1);
-    case 4:
-    SSE_L2SQR(e_l, e_r, sum, l0, r0);
-  default:
-    break;
-}
-for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-    SSE_L2SQR(l, r, sum, l0, r0);
-    SSE_L2SQR(l + 4, r + 4, sum, l1, r1);
-    SSE_L2SQR(l + 8, r + 8, sum, l2, r2);
-    SSE_L2SQR(l + 12, r + 12, sum, l3, r3);
-}
-_mm_storeu_ps(unpack, sum);
-result += unpack[0] + unpack[1] + unpack[2] + unpack[3];
-*/
-// normal distance
-#else
+// four independent accumulators hide the latency of the fma chain;
+// the tail is handled with a masked load instead of a scalar loop
+__attribute__((target("avx512f")))
+inline float l2_sqr_avx512(const float *a, const float *b, unsigned size) {
+  __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+  __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+    __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+    __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+    sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+    sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+    sum2 = _mm512_fmadd_ps(d2, d2, sum2);
+    sum3 = _mm512_fmadd_ps(d3, d3, sum3);
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+  }
+  if (i < size) {
+    __mmask16 mask = (__mmask16) ((1u << (size - i)) - 1);
+    __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                              _mm512_maskz_loadu_ps(mask, b + i));
+    sum1 = _mm512_fmadd_ps(d0, d0, sum1);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(sum0, sum1),
+                                              _mm512_add_ps(sum2, sum3)));
+}
 
-    float diff0, diff1, diff2, diff3;
-    const float *last = a + size;
-    const float *unroll_group = last - 3;
+inline float dot_scalar(const float *a, const float *b, unsigned size) {
+  float result = 0;
+  float dot0, dot1, dot2, dot3;
+  const float *last = a + size;
+  const float *unroll_group = last - 3;
+
+  /* Process 4 items with each loop for efficiency. */
+  while (a < unroll_group) {
+    dot0 = a[0] * b[0];
+    dot1 = a[1] * b[1];
+    dot2 = a[2] * b[2];
+    dot3 = a[3] * b[3];
+    result += dot0 + dot1 + dot2 + dot3;
+    a += 4;
+    b += 4;
+  }
+  /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
+  while (a < last) {
+    result += *a++ * *b++;
+  }
+  return result;
+}
 
-    /* Process 4 items with each loop for efficiency. */
-    while (a < unroll_group) {
-      diff0 = a[0] - b[0];
-      diff1 = a[1] - b[1];
-      diff2 = a[2] - b[2];
-      diff3 = a[3] - b[3];
-      result += diff0 * diff0 + diff1 * diff1 + diff2 * diff2 + diff3 * diff3;
-      a += 4;
-      b += 4;
-    }
-    /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
-    while (a < last) {
-      diff0 = *a++ - *b++;
-      result += diff0 * diff0;
-    }
-// #endif
-#endif
-#endif
+inline float dot_sse(const float *a, const float *b, unsigned size) {
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  unsigned i = 0;
+  for (; i + 8 <= size; i += 8) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  float unpack[4] __attribute__((aligned(16)));
+  _mm_store_ps(unpack, _mm_add_ps(sum0, sum1));
+  float result = unpack[0] + unpack[1] + unpack[2] + unpack[3];
+  for (; i < size; i++)
+    result += a[i] * b[i];
+  return result;
+}
 
-    return result;
+__attribute__((target("avx2,fma")))
+inline float dot_avx2(const float *a, const float *b, unsigned size) {
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 32 <= size; i += 32) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), sum2);
+    sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), sum3);
   }
-};
+  for (; i + 8 <= size; i += 8)
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+  __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_movehdup_ps(half));
+  float result = _mm_cvtss_f32(half);
+  for (; i < size; i++)
+    result += a[i] * b[i];
+  return result;
+}
 
-class DistanceInnerProduct : public Distance {
- public:
-  float compare(const float *a, const float *b, unsigned size) const {
-    float result = 0;
-#ifdef __GNUC__
-#ifdef __AVX__
-#define AVX_DOT(addr1, addr2, dest, tmp1, tmp2) \
-  tmp1 = _mm256_loadu_ps(addr1);                \
-  tmp2 = _mm256_loadu_ps(addr2);                \
-  tmp1 = _mm256_mul_ps(tmp1, tmp2);             \
-  dest = _mm256_add_ps(dest, tmp1);
+__attribute__((target("avx512f")))
+inline float dot_avx512(const float *a, const float *b, unsigned size) {
+  __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+  __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 64 <= size; i += 64) {
+    sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+    sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), sum1);
+    sum2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), sum2);
+    sum3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), sum3);
+  }
+  for (; i + 16 <= size; i += 16)
+    sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+  if (i < size) {
+    __mmask16 mask = (__mmask16) ((1u << (size - i)) - 1);
+    sum1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                           _mm512_maskz_loadu_ps(mask, b + i), sum1);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(sum0, sum1),
+                                              _mm512_add_ps(sum2, sum3)));
+}
 
-    __m256 sum;
-    __m256 l0, l1;
-    __m256 r0, r1;
-    unsigned D = (size + 7) & ~7U;
-    unsigned DR = D % 16;
-    unsigned DD = D - DR;
-    const float *l = a;
-    const float *r = b;
-    const float *e_l = l + DD;
-    const float *e_r = r + DD;
-    float unpack[8] __attribute__((aligned(32))) = {0, 0, 0, 0, 0, 0, 0, 0};
+typedef float (*float_kernel_t)(const float *, const float *, unsigned);
+
+static const float_kernel_t l2_sqr =
+    select_kernel<float_kernel_t>(l2_sqr_avx512, l2_sqr_avx2, l2_sqr_sse, l2_sqr_scalar);
+static const float_kernel_t dot =
+    select_kernel<float_kernel_t>(dot_avx512, dot_avx2, dot_sse, dot_scalar);
+
+// Kernels over 1-byte vectors (uint8 and int8 points, and the 1-byte
+// quantized points).  Both operands are widened to 16 bits before the
+// multiply, so results are exact: maddubs would saturate on
+// (-128)*(-128) pairs.  Products are pairwise summed into 32-bit lanes with
+// madd on AVX2 and with the VNNI dpwssd instruction on AVX-512.
+inline bool detect_avx512_vnni() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+}
 
-    sum = _mm256_loadu_ps(unpack);
-    if (DR) {
-      AVX_DOT(e_l, e_r, sum, l0, r0);
-    }
+template<typename Kernel>
+Kernel select_byte_kernel(Kernel vnni, Kernel avx2, Kernel scalar) {
+  if (detect_avx512_vnni()) return vnni;
+  return select_kernel(avx2, avx2, scalar, scalar);
+}
 
-    for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-      AVX_DOT(l, r, sum, l0, r0);
-      AVX_DOT(l + 8, r + 8, sum, l1, r1);
-    }
-    _mm256_storeu_ps(unpack, sum);
-    result = unpack[0] + unpack[1] + unpack[2] + unpack[3] + unpack[4] +
-             unpack[5] + unpack[6] + unpack[7];
-/*
-#else
-#ifdef __SSE2__
-      #define SSE_DOT(addr1, addr2, dest, tmp1, tmp2) \
-          tmp1 = _mm128_loadu_ps(addr1);\
-          tmp2 = _mm128_loadu_ps(addr2);\
-          tmp1 = _mm128_mul_ps(tmp1, tmp2); \
-          dest = _mm128_add_ps(dest, tmp1);
-      __m128 sum;
-      __m128 l0, l1, l2, l3;
-      __m128 r0, r1, r2, r3;
-      unsigned D = (size + 3) & ~3U;
-      unsigned DR = D % 16;
-      unsigned DD = D - DR;
-      const float *l = a;
-      const float *r = b;
-      const float *e_l = l + DD;
-      const float *e_r = r + DD;
-      float unpack[4] __attribute__ ((aligned (16))) = {0, 0, 0, 0};
-
-      sum = _mm_load_ps(unpack);
-      switch (DR) {
-          case 12:
-          SSE_DOT(e_l+8, e_r+8, sum, l2, r2);
-          case 8:
-          SSE_DOT(e_l+4, e_r+4, sum, l1, r1);
-          case 4:
-          SSE_DOT(e_l, e_r, sum, l0, r0);
-        default:
-          break;
-      }
-      for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-          SSE_DOT(l, r, sum, l0, r0);
-          SSE_DOT(l + 4, r + 4, sum, l1, r1);
-          SSE_DOT(l + 8, r + 8, sum, l2, r2);
-          SSE_DOT(l + 12, r + 12, sum, l3, r3);
-      }
-      _mm_storeu_ps(unpack, sum);
-      result += unpack[0] + unpack[1] + unpack[2] + unpack[3];
-*/
-#else
+template<typename T>
+float l2_sqr_bytes_scalar(const T *a, const T *b, unsigned size) {
+  int32_t result = 0;
+  for (unsigned i = 0; i < size; i++) {
+    int32_t diff = (int32_t) a[i] - (int32_t) b[i];
+    result += diff * diff;
+  }
+  return (float) result;
+}
 
-    float dot0, dot1, dot2, dot3;
-    const float *last = a + size;
-    const float *unroll_group = last - 3;
+template<typename T>
+float dot_bytes_scalar(const T *a, const T *b, unsigned size) {
+  int32_t result = 0;
+  for (unsigned i = 0; i < size; i++)
+    result += (int32_t) a[i] * (int32_t) b[i];
+  return (float) result;
+}
 
-    /* Process 4 items with each loop for efficiency. */
-    while (a < unroll_group) {
-      dot0 = a[0] * b[0];
-      dot1 = a[1] * b[1];
-      dot2 = a[2] * b[2];
-      dot3 = a[3] * b[3];
-      result += dot0 + dot1 + dot2 + dot3;
-      a += 4;
-      b += 4;
-    }
-    /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
-    while (a < last) {
-      result += *a++ * *b++;
-    }
-// #endif
-#endif
-#endif
-    return result;
+template<typename T>
+__attribute__((target("avx2")))
+inline __m256i widen_bytes_avx2(const T *p) {
+  __m128i x = _mm_loadu_si128((const __m128i *) p);
+  return std::is_signed<T>::value ? _mm256_cvtepi8_epi16(x) : _mm256_cvtepu8_epi16(x);
+}
+
+__attribute__((target("avx2")))
+inline int32_t hsum_epi32_avx2(__m256i x) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+float l2_sqr_bytes_avx2(const T *a, const T *b, unsigned size) {
+  __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+  unsigned i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i d0 = _mm256_sub_epi16(widen_bytes_avx2(a + i), widen_bytes_avx2(b + i));
+    __m256i d1 = _mm256_sub_epi16(widen_bytes_avx2(a + i + 16), widen_bytes_avx2(b + i + 16));
+    sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(d0, d0));
+    sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(d1, d1));
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m256i d0 = _mm256_sub_epi16(widen_bytes_avx2(a + i), widen_bytes_avx2(b + i));
+    sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(d0, d0));
+  }
+  int32_t result = hsum_epi32_avx2(_mm256_add_epi32(sum0, sum1));
+  for (; i < size; i++) {
+    int32_t diff = (int32_t) a[i] - (int32_t) b[i];
+    result += diff * diff;
+  }
+  return (float) result;
+}
+
+template<typename T>
+__attribute__((target("avx2")))
+float dot_bytes_avx2(const T *a, const T *b, unsigned size) {
+  __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+  unsigned i = 0;
+  for (; i + 32 <= size; i += 32) {
+    sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(widen_bytes_avx2(a + i), widen_bytes_avx2(b + i)));
+    sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(widen_bytes_avx2(a + i + 16),
+                                                     widen_bytes_avx2(b + i + 16)));
+  }
+  for (; i + 16 <= size; i += 16)
+    sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(widen_bytes_avx2(a + i), widen_bytes_avx2(b + i)));
+  int32_t result = hsum_epi32_avx2(_mm256_add_epi32(sum0, sum1));
+  for (; i < size; i++)
+    result += (int32_t) a[i] * (int32_t) b[i];
+  return (float) result;
+}
+
+template<typename T>
+__attribute__((target("avx512bw,avx512vnni")))
+inline __m512i widen_bytes_avx512(const T *p) {
+  __m256i x = _mm256_loadu_si256((const __m256i *) p);
+  return std::is_signed<T>::value ? _mm512_cvtepi8_epi16(x) : _mm512_cvtepu8_epi16(x);
+}
+
+template<typename T>
+__attribute__((target("avx512bw,avx512vnni")))
+float l2_sqr_bytes_vnni(const T *a, const T *b, unsigned size) {
+  __m512i sum0 = _mm512_setzero_si512(), sum1 = _mm512_setzero_si512();
+  unsigned i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m512i d0 = _mm512_sub_epi16(widen_bytes_avx512(a + i), widen_bytes_avx512(b + i));
+    __m512i d1 = _mm512_sub_epi16(widen_bytes_avx512(a + i + 32), widen_bytes_avx512(b + i + 32));
+    sum0 = _mm512_dpwssd_epi32(sum0, d0, d0);
+    sum1 = _mm512_dpwssd_epi32(sum1, d1, d1);
+  }
+  for (; i + 32 <= size; i += 32) {
+    __m512i d0 = _mm512_sub_epi16(widen_bytes_avx512(a + i), widen_bytes_avx512(b + i));
+    sum0 = _mm512_dpwssd_epi32(sum0, d0, d0);
+  }
+  int32_t result = _mm512_reduce_add_epi32(_mm512_add_epi32(sum0, sum1));
+  for (; i < size; i++) {
+    int32_t diff = (int32_t) a[i] - (int32_t) b[i];
+    result += diff * diff;
+  }
+  return (float) result;
+}
+
+template<typename T>
+__attribute__((target("avx512bw,avx512vnni")))
+float dot_bytes_vnni(const T *a, const T *b, unsigned size) {
+  __m512i sum0 = _mm512_setzero_si512(), sum1 = _mm512_setzero_si512();
+  unsigned i = 0;
+  for (; i + 64 <= size; i += 64) {
+    sum0 = _mm512_dpwssd_epi32(sum0, widen_bytes_avx512(a + i), widen_bytes_avx512(b + i));
+    sum1 = _mm512_dpwssd_epi32(sum1, widen_bytes_avx512(a + i + 32), widen_bytes_avx512(b + i + 32));
+  }
+  for (; i + 32 <= size; i += 32)
+    sum0 = _mm512_dpwssd_epi32(sum0, widen_bytes_avx512(a + i), widen_bytes_avx512(b + i));
+  int32_t result = _mm512_reduce_add_epi32(_mm512_add_epi32(sum0, sum1));
+  for (; i < size; i++)
+    result += (int32_t) a[i] * (int32_t) b[i];
+  return (float) result;
+}
+
+typedef float (*uint8_kernel_t)(const uint8_t *, const uint8_t *, unsigned);
+typedef float (*int8_kernel_t)(const int8_t *, const int8_t *, unsigned);
+
+static const uint8_kernel_t l2_sqr_uint8 = select_byte_kernel<uint8_kernel_t>(
+    l2_sqr_bytes_vnni<uint8_t>, l2_sqr_bytes_avx2<uint8_t>, l2_sqr_bytes_scalar<uint8_t>);
+static const int8_kernel_t l2_sqr_int8 = select_byte_kernel<int8_kernel_t>(
+    l2_sqr_bytes_vnni<int8_t>, l2_sqr_bytes_avx2<int8_t>, l2_sqr_bytes_scalar<int8_t>);
+static const uint8_kernel_t dot_uint8 = select_byte_kernel<uint8_kernel_t>(
+    dot_bytes_vnni<uint8_t>, dot_bytes_avx2<uint8_t>, dot_bytes_scalar<uint8_t>);
+static const int8_kernel_t dot_int8 = select_byte_kernel<int8_kernel_t>(
+    dot_bytes_vnni<int8_t>, dot_bytes_avx2<int8_t>, dot_bytes_scalar<int8_t>);
+
+// Kernels over 2-byte floating point vectors (float16 and bfloat16 points),
+// taking the raw bits of the values.  Both are widened to float, fp16 with
+// the F16C conversions (present on every AVX2 part) and bf16 by shifting it
+// into the top half of a float, and all arithmetic is done in float.  Dot
+// products of bf16 vectors use the AVX512-BF16 dpbf16 instruction when the
+// machine has it.
+inline float fp16_to_float(uint16_t h) {
+  uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t bits;
+  if (exp == 0x1f) bits = sign | 0x7f800000 | (mant << 13);
+  else if (exp != 0) bits = sign | ((exp + 112) << 23) | (mant << 13);
+  else if (mant == 0) bits = sign;
+  else {  // subnormal, renormalize it
+    exp = 113;
+    while (!(mant & 0x400)) { mant <<= 1; exp--; }
+    bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+  }
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// rounds to nearest even, overflowing to infinity
+inline uint16_t float_to_fp16(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  uint16_t sign = (x >> 16) & 0x8000;
+  uint32_t abs_x = x & 0x7fffffff;
+  if (abs_x > 0x7f800000) return sign | 0x7e00;
+  if (abs_x >= 0x477ff000) return sign | 0x7c00;
+  if (abs_x < 0x38800000)  // subnormal in fp16, which is a multiple of 2^-24
+    return sign | (uint16_t) std::nearbyint(std::fabs(f) * 16777216.0f);
+  uint32_t h = (((abs_x >> 23) - 112) << 10) | ((abs_x >> 13) & 0x3ff);
+  uint32_t rest = abs_x & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+  return sign | (uint16_t) h;
+}
+
+inline float bf16_to_float(uint16_t h) {
+  uint32_t bits = (uint32_t) h << 16;
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// rounds to nearest even
+inline uint16_t float_to_bf16(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  if ((x & 0x7fffffff) > 0x7f800000) return (x >> 16) | 0x40;
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+template<bool bf16>
+inline float half_to_float(uint16_t h) {
+  return bf16 ? bf16_to_float(h) : fp16_to_float(h);
+}
+
+template<bool bf16>
+float l2_sqr_half_scalar(const uint16_t *a, const uint16_t *b, unsigned size) {
+  float result = 0;
+  for (unsigned i = 0; i < size; i++) {
+    float diff = half_to_float<bf16>(a[i]) - half_to_float<bf16>(b[i]);
+    result += diff * diff;
+  }
+  return result;
+}
+
+template<bool bf16>
+float dot_half_scalar(const uint16_t *a, const uint16_t *b, unsigned size) {
+  float result = 0;
+  for (unsigned i = 0; i < size; i++)
+    result += half_to_float<bf16>(a[i]) * half_to_float<bf16>(b[i]);
+  return result;
+}
+
+template<bool bf16>
+__attribute__((target("avx2,fma,f16c")))
+inline __m256 widen_half_avx2(const uint16_t *p) {
+  __m128i x = _mm_loadu_si128((const __m128i *) p);
+  if (bf16) return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(x), 16));
+  return _mm256_cvtph_ps(x);
+}
+
+__attribute__((target("avx2")))
+inline float hsum_ps_avx2(__m256 x) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+template<bool bf16>
+__attribute__((target("avx2,fma,f16c")))
+float l2_sqr_half_avx2(const uint16_t *a, const uint16_t *b, unsigned size) {
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m256 d0 = _mm256_sub_ps(widen_half_avx2<bf16>(a + i), widen_half_avx2<bf16>(b + i));
+    __m256 d1 = _mm256_sub_ps(widen_half_avx2<bf16>(a + i + 8), widen_half_avx2<bf16>(b + i + 8));
+    sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+    sum1 = _mm256_fmadd_ps(d1, d1, sum1);
+  }
+  for (; i + 8 <= size; i += 8) {
+    __m256 d0 = _mm256_sub_ps(widen_half_avx2<bf16>(a + i), widen_half_avx2<bf16>(b + i));
+    sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+  }
+  float result = hsum_ps_avx2(_mm256_add_ps(sum0, sum1));
+  return result + l2_sqr_half_scalar<bf16>(a + i, b + i, size - i);
+}
+
+template<bool bf16>
+__attribute__((target("avx2,fma,f16c")))
+float dot_half_avx2(const uint16_t *a, const uint16_t *b, unsigned size) {
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 16 <= size; i += 16) {
+    sum0 = _mm256_fmadd_ps(widen_half_avx2<bf16>(a + i), widen_half_avx2<bf16>(b + i), sum0);
+    sum1 = _mm256_fmadd_ps(widen_half_avx2<bf16>(a + i + 8), widen_half_avx2<bf16>(b + i + 8), sum1);
+  }
+  for (; i + 8 <= size; i += 8)
+    sum0 = _mm256_fmadd_ps(widen_half_avx2<bf16>(a + i), widen_half_avx2<bf16>(b + i), sum0);
+  float result = hsum_ps_avx2(_mm256_add_ps(sum0, sum1));
+  return result + dot_half_scalar<bf16>(a + i, b + i, size - i);
+}
+
+template<bool bf16>
+__attribute__((target("avx512f")))
+inline __m512 widen_half_avx512(const uint16_t *p) {
+  __m256i x = _mm256_loadu_si256((const __m256i *) p);
+  if (bf16) return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(x), 16));
+  return _mm512_cvtph_ps(x);
+}
+
+template<bool bf16>
+__attribute__((target("avx512f")))
+float l2_sqr_half_avx512(const uint16_t *a, const uint16_t *b, unsigned size) {
+  __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m512 d0 = _mm512_sub_ps(widen_half_avx512<bf16>(a + i), widen_half_avx512<bf16>(b + i));
+    __m512 d1 = _mm512_sub_ps(widen_half_avx512<bf16>(a + i + 16), widen_half_avx512<bf16>(b + i + 16));
+    sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+    sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+  }
+  for (; i + 16 <= size; i += 16) {
+    __m512 d0 = _mm512_sub_ps(widen_half_avx512<bf16>(a + i), widen_half_avx512<bf16>(b + i));
+    sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+  }
+  float result = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+  return result + l2_sqr_half_scalar<bf16>(a + i, b + i, size - i);
+}
+
+template<bool bf16>
+__attribute__((target("avx512f")))
+float dot_half_avx512(const uint16_t *a, const uint16_t *b, unsigned size) {
+  __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 32 <= size; i += 32) {
+    sum0 = _mm512_fmadd_ps(widen_half_avx512<bf16>(a + i), widen_half_avx512<bf16>(b + i), sum0);
+    sum1 = _mm512_fmadd_ps(widen_half_avx512<bf16>(a + i + 16), widen_half_avx512<bf16>(b + i + 16), sum1);
   }
+  for (; i + 16 <= size; i += 16)
+    sum0 = _mm512_fmadd_ps(widen_half_avx512<bf16>(a + i), widen_half_avx512<bf16>(b + i), sum0);
+  float result = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+  return result + dot_half_scalar<bf16>(a + i, b + i, size - i);
+}
+
+__attribute__((target("avx512f,avx512bf16")))
+inline float dot_bf16_dpbf16(const uint16_t *a, const uint16_t *b, unsigned size) {
+  __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 64 <= size; i += 64) {
+    sum0 = _mm512_dpbf16_ps(sum0, (__m512bh) _mm512_loadu_si512(a + i),
+                            (__m512bh) _mm512_loadu_si512(b + i));
+    sum1 = _mm512_dpbf16_ps(sum1, (__m512bh) _mm512_loadu_si512(a + i + 32),
+                            (__m512bh) _mm512_loadu_si512(b + i + 32));
+  }
+  for (; i + 32 <= size; i += 32)
+    sum0 = _mm512_dpbf16_ps(sum0, (__m512bh) _mm512_loadu_si512(a + i),
+                            (__m512bh) _mm512_loadu_si512(b + i));
+  float result = _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+  return result + dot_half_scalar<true>(a + i, b + i, size - i);
+}
+
+typedef float (*half_kernel_t)(const uint16_t *, const uint16_t *, unsigned);
+
+inline half_kernel_t select_dot_bf16() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bf16")) return dot_bf16_dpbf16;
+  return select_kernel<half_kernel_t>(dot_half_avx512<true>, dot_half_avx2<true>,
+                                      dot_half_scalar<true>, dot_half_scalar<true>);
+}
+
+static const half_kernel_t l2_sqr_fp16 = select_kernel<half_kernel_t>(
+    l2_sqr_half_avx512<false>, l2_sqr_half_avx2<false>, l2_sqr_half_scalar<false>, l2_sqr_half_scalar<false>);
+static const half_kernel_t dot_fp16 = select_kernel<half_kernel_t>(
+    dot_half_avx512<false>, dot_half_avx2<false>, dot_half_scalar<false>, dot_half_scalar<false>);
+static const half_kernel_t l2_sqr_bf16 = select_kernel<half_kernel_t>(
+    l2_sqr_half_avx512<true>, l2_sqr_half_avx2<true>, l2_sqr_half_scalar<true>, l2_sqr_half_scalar<true>);
+static const half_kernel_t dot_bf16 = select_dot_bf16();
+
+// Squared L2 distance between scalar quantized vectors whose dimensions
+// each have their own scale, weighted per dimension by w to undo the
+// scaling.  The codes are widened to float, so the sums are not exact
+// integers as in the kernels above.
+template<typename T>
+float l2_sqr_weighted_scalar(const T *a, const T *b, const float *w, unsigned size) {
+  float result = 0;
+  for (unsigned i = 0; i < size; i++) {
+    float diff = (float) a[i] - (float) b[i];
+    result += w[i] * diff * diff;
+  }
+  return result;
+}
+
+template<typename T>
+__attribute__((target("avx2,fma")))
+inline __m256 widen_to_float_avx2(const T *p) {
+  __m256i x;
+  if constexpr (sizeof(T) == 1) {
+    __m128i y = _mm_loadl_epi64((const __m128i *) p);
+    x = std::is_signed<T>::value ? _mm256_cvtepi8_epi32(y) : _mm256_cvtepu8_epi32(y);
+  } else {
+    __m128i y = _mm_loadu_si128((const __m128i *) p);
+    x = std::is_signed<T>::value ? _mm256_cvtepi16_epi32(y) : _mm256_cvtepu16_epi32(y);
+  }
+  return _mm256_cvtepi32_ps(x);
+}
+
+template<typename T>
+__attribute__((target("avx2,fma")))
+float l2_sqr_weighted_avx2(const T *a, const T *b, const float *w, unsigned size) {
+  __m256 sum = _mm256_setzero_ps();
+  unsigned i = 0;
+  for (; i + 8 <= size; i += 8) {
+    __m256 diff = _mm256_sub_ps(widen_to_float_avx2(a + i), widen_to_float_avx2(b + i));
+    sum = _mm256_fmadd_ps(_mm256_mul_ps(diff, _mm256_loadu_ps(w + i)), diff, sum);
+  }
+  return hsum_ps_avx2(sum) + l2_sqr_weighted_scalar(a + i, b + i, w + i, size - i);
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+inline __m512 widen_to_float_avx512(const T *p) {
+  __m512i x;
+  if constexpr (sizeof(T) == 1) {
+    __m128i y = _mm_loadu_si128((const __m128i *) p);
+    x = std::is_signed<T>::value ? _mm512_cvtepi8_epi32(y) : _mm512_cvtepu8_epi32(y);
+  } else {
+    __m256i y = _mm256_loadu_si256((const __m256i *) p);
+    x = std::is_signed<T>::value ? _mm512_cvtepi16_epi32(y) : _mm512_cvtepu16_epi32(y);
+  }
+  return _mm512_cvtepi32_ps(x);
+}
+
+template<typename T>
+__attribute__((target("avx512f")))
+float l2_sqr_weighted_avx512(const T *a, const T *b, const float *w, unsigned size) {
+  __m512 sum = _mm512_setzero_ps();
+  unsigned i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m512 diff = _mm512_sub_ps(widen_to_float_avx512(a + i), widen_to_float_avx512(b + i));
+    sum = _mm512_fmadd_ps(_mm512_mul_ps(diff, _mm512_loadu_ps(w + i)), diff, sum);
+  }
+  return _mm512_reduce_add_ps(sum) + l2_sqr_weighted_scalar(a + i, b + i, w + i, size - i);
+}
+
+typedef float (*uint8_weighted_kernel_t)(const uint8_t *, const uint8_t *, const float *, unsigned);
+typedef float (*uint16_weighted_kernel_t)(const uint16_t *, const uint16_t *, const float *, unsigned);
+
+static const uint8_weighted_kernel_t l2_sqr_weighted_uint8 = select_kernel<uint8_weighted_kernel_t>(
+    l2_sqr_weighted_avx512<uint8_t>, l2_sqr_weighted_avx2<uint8_t>,
+    l2_sqr_weighted_scalar<uint8_t>, l2_sqr_weighted_scalar<uint8_t>);
+static const uint16_weighted_kernel_t l2_sqr_weighted_uint16 = select_kernel<uint16_weighted_kernel_t>(
+    l2_sqr_weighted_avx512<uint16_t>, l2_sqr_weighted_avx2<uint16_t>,
+    l2_sqr_weighted_scalar<uint16_t>, l2_sqr_weighted_scalar<uint16_t>);
+
+// Hamming distance between bit vectors stored in 64-bit words (binary
+// quantized points).  Eight words at a time are counted with the AVX-512
+// VPOPCNTDQ instruction when the machine has it, and one at a time with
+// popcnt otherwise.
+inline float hamming_scalar(const uint64_t *a, const uint64_t *b, unsigned words) {
+  uint32_t result = 0;
+  for (unsigned i = 0; i < words; i++)
+    result += __builtin_popcountll(a[i] ^ b[i]);
+  return (float) result;
+}
+
+__attribute__((target("popcnt")))
+inline float hamming_popcnt(const uint64_t *a, const uint64_t *b, unsigned words) {
+  uint64_t r0 = 0, r1 = 0;
+  unsigned i = 0;
+  for (; i + 2 <= words; i += 2) {
+    r0 += _mm_popcnt_u64(a[i] ^ b[i]);
+    r1 += _mm_popcnt_u64(a[i + 1] ^ b[i + 1]);
+  }
+  if (i < words) r0 += _mm_popcnt_u64(a[i] ^ b[i]);
+  return (float) (r0 + r1);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+inline float hamming_vpopcntdq(const uint64_t *a, const uint64_t *b, unsigned words) {
+  __m512i sum = _mm512_setzero_si512();
+  unsigned i = 0;
+  for (; i + 8 <= words; i += 8) {
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+    sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+  }
+  if (i < words) {
+    __mmask8 mask = (__mmask8) ((1u << (words - i)) - 1);
+    __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi64(mask, a + i),
+                                 _mm512_maskz_loadu_epi64(mask, b + i));
+    sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+  }
+  return (float) _mm512_reduce_add_epi64(sum);
+}
+
+typedef float (*hamming_kernel_t)(const uint64_t *, const uint64_t *, unsigned);
+
+inline hamming_kernel_t select_hamming() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512vpopcntdq")) return hamming_vpopcntdq;
+  if (__builtin_cpu_supports("popcnt")) return hamming_popcnt;
+  return hamming_scalar;
+}
+
+static const hamming_kernel_t hamming = select_hamming();
+
+class Distance {
+ public:
+  virtual float compare(const float *a, const float *b,
+                        unsigned length) const = 0;
+
+  virtual ~Distance() {}
 };
+
+class DistanceL2 : public Distance {
+ public:
+  float compare(const float *a, const float *b, unsigned size) const {
+    return l2_sqr(a, b, size);
+  }
+};
+
+class DistanceInnerProduct : public Distance {
+ public:
+  float compare(const float *a, const float *b, unsigned size) const {
+    return dot(a, b, size);
+  }
+};
+
 class DistanceFastL2 : public DistanceInnerProduct {
  public:
   float norm(const float *a, unsigned size) const {
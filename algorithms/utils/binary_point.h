@@ -0,0 +1,175 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "parlay/random.h"
+#include "NSGDist.h"
+#include "entry_points.h"
+
+// Binary quantization.  Each point is centered on the mean of the base
+// points, optionally multiplied by a random rotation so that no coordinate
+// carries much more of the variance than the others, and then reduced to
+// the sign bit of every coordinate.  The distance is the Hamming distance
+// between the bit vectors, which approximates the angle between the
+// centered vectors.  This is only accurate enough to steer a search; the
+// results are expected to be reranked with the full vectors.
+struct Binary_Point {
+  using distanceType = float;
+
+  struct parameters {
+    int dims;
+    int words;  // 64-bit words per point
+    parameters() : dims(0), words(0) {}
+    parameters(int dims) : dims(dims), words((dims + 63) / 64) {}
+  };
+
+  static distanceType d_min() {return 0;}
+  static bool is_metric() {return true;}
+
+  float distance(const Binary_Point& x) const {
+    return efanna2e::hamming(bits, x.bits, params.words);
+  }
+
+  void prefetch() const {
+    int l = (params.words * sizeof(uint64_t) - 1)/64 + 1;
+    for (int i=0; i < l; i++)
+      __builtin_prefetch((char*) bits + i * 64);
+  }
+
+  bool same_as(const Binary_Point& q) const {
+    return bits == q.bits;
+  }
+
+  long id() const {return id_;}
+
+  Binary_Point(const uint64_t* bits, long id, parameters params)
+    : bits(bits), id_(id), params(params) {}
+
+  void normalize() {
+    std::cout << "can't normalize binary point" << std::endl;
+    abort();
+  }
+
+private:
+  const uint64_t* bits;
+  long id_;
+  parameters params;
+};
+
+// A range of binary quantized points.  Built from a base PointRange it
+// computes the mean (and the rotation, if asked for); built from a query
+// PointRange and an existing range it reuses them.
+struct Binary_PointRange {
+  using Point = Binary_Point;
+  using parameters = Binary_Point::parameters;
+
+  Binary_PointRange() : n(0), dims(0) {}
+
+  template <typename PR>
+  Binary_PointRange(const PR& pr, bool rotate) : params(pr.dimension()), n(pr.size()), dims(pr.dimension()) {
+    mean = std::shared_ptr<float[]>(new float[dims]);
+    auto all = parlay::delayed_tabulate(n, [] (size_t i) {return i;});
+    std::vector<double> m = mean_point(pr, all);
+    for (int j = 0; j < dims; j++) mean[j] = m[j];
+    if (rotate) random_rotation();
+    encode_all(pr);
+  }
+
+  template <typename PR>
+  Binary_PointRange(const PR& pr, const Binary_PointRange& BR)
+    : params(BR.params), n(pr.size()), dims(BR.dims), mean(BR.mean), rotation(BR.rotation) {
+    encode_all(pr);
+  }
+
+  size_t size() const { return n; }
+  long dimension() const {return dims;}
+  unsigned int get_dims() const { return dims; }
+
+  Point operator [] (long i) const {
+    if (i > n) {
+      std::cout << "ERROR: point index out of range: " << i << " from range " << n << ", " << std::endl;
+      abort();
+    }
+    return Point(bits.get() + i * params.words, i, params);
+  }
+
+  parameters params;
+
+private:
+  // a random orthogonal matrix, from Gram-Schmidt on a Gaussian matrix
+  void random_rotation() {
+    rotation = std::shared_ptr<float[]>(new float[(long) dims * dims]);
+    float* R = rotation.get();
+    std::mt19937 gen(dims);
+    std::normal_distribution<float> dis(0.0, 1.0);
+    for (long i = 0; i < (long) dims * dims; i++) R[i] = dis(gen);
+    for (int i = 0; i < dims; i++) {
+      float* ri = R + (long) i * dims;
+      for (int k = 0; k < i; k++) {
+        float* rk = R + (long) k * dims;
+        float d = efanna2e::dot(ri, rk, dims);
+        for (int j = 0; j < dims; j++) ri[j] -= d * rk[j];
+      }
+      float norm = std::sqrt(efanna2e::dot(ri, ri, dims));
+      for (int j = 0; j < dims; j++) ri[j] /= norm;
+    }
+  }
+
+  template <typename PR>
+  void encode_all(const PR& pr) {
+    long num_bytes = n * params.words * sizeof(uint64_t);
+    uint64_t* ptr = (uint64_t*) aligned_alloc(1l << 21, num_bytes);
+    madvise(ptr, num_bytes, MADV_HUGEPAGE);
+    bits = std::shared_ptr<uint64_t[]>(ptr, std::free);
+    parlay::parallel_for(0, n, [&] (long i) {
+      auto p = pr[i];
+      std::vector<float> v(dims);
+      for (int j = 0; j < dims; j++) v[j] = (float) p[j] - mean[j];
+      uint64_t* b = ptr + i * params.words;
+      for (int w = 0; w < params.words; w++) b[w] = 0;
+      for (int j = 0; j < dims; j++) {
+        float x = (rotation == nullptr) ? v[j]
+          : efanna2e::dot(rotation.get() + (long) j * dims, v.data(), dims);
+        if (x > 0) b[j / 64] |= (uint64_t) 1 << (j % 64);
+      }
+    });
+  }
+
+  size_t n;
+  int dims;
+  std::shared_ptr<float[]> mean;
+  std::shared_ptr<float[]> rotation;  // dims x dims, or null for none
+  std::shared_ptr<uint64_t[]> bits;
+};
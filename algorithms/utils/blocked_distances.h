@@ -0,0 +1,54 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+
+// Computes the distance between every one of n_rows row points and every
+// one of n_cols column points, calling f(i, j, distance) for each pair.
+// Like a blocked matrix product, the pairs are visited tile by tile: each
+// tile of row_block rows is scored against col_block columns at a time, so
+// the column vectors are read from cache for all but the first row of the
+// tile.  row(i) and col(j) return the points.  Tiles of rows run in
+// parallel; within a tile, f is called with increasing j for each i, so
+// per-row state needs no synchronization.
+template<typename Rows, typename Cols, typename F>
+void blocked_distances(size_t n_rows, Rows row, size_t n_cols, Cols col, F f,
+                       size_t row_block = 16, size_t col_block = 256) {
+  size_t num_tiles = (n_rows + row_block - 1) / row_block;
+  parlay::parallel_for(0, num_tiles, [&] (size_t t) {
+    size_t row_start = t * row_block;
+    size_t row_end = std::min(n_rows, row_start + row_block);
+    for (size_t col_start = 0; col_start < n_cols; col_start += col_block) {
+      size_t col_end = std::min(n_cols, col_start + col_block);
+      for (size_t i = row_start; i < row_end; i++) {
+        auto p = row(i);
+        for (size_t j = col_start; j < col_end; j++)
+          f(i, j, p.distance(col(j)));
+      }
+    }
+  }, 1);
+}
@@ -21,10 +21,12 @@
 // WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <algorithm>
+#include <numeric>
 #include <set>
 
 #include "beamSearch.h"
 #include "csvfile.h"
+#include "labels.h"
 #include "parse_results.h"
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
@@ -40,7 +42,8 @@ nn_result checkRecall(
         QPointRange &Q_Query_Points,
         groundTruth<indexType> GT,
         bool random,
-        long start_point, 
+        const parlay::sequence<indexType> &starting_points,
+        const NavigationLayer<indexType> &nav,
         long k,
         QueryParams &QP,
         bool verbose) {
@@ -50,7 +53,7 @@ nn_result checkRecall(
     abort();
   }
   
-  parlay::sequence<parlay::sequence<indexType>> all_ngh;
+  SearchResults<indexType, typename Point::distanceType> results;
 
   parlay::internal::timer t;
   float query_time;
@@ -58,11 +61,17 @@ nn_result checkRecall(
   QueryStats.clear();
   // to help clear the cache between runs
   auto volatile xx = parlay::random_permutation<long>(5000000);
+  // the pools are shared by all the calls, so the visited tables are only
+  // allocated by the first one
+  auto &scratch_pool = SearchScratchPool<indexType, typename Point::distanceType>::shared();
+  auto &q_scratch_pool = SearchScratchPool<indexType, typename QPointRange::Point::distanceType>::shared();
   t.next_time();
   if (random) {
-    all_ngh = beamSearchRandom<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats, QP);
+    results = beamSearchRandom<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats, QP, scratch_pool);
+  } else if (nav.size() > 0) {
+    results = qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points, Q_Base_Points, QueryStats, nav, QP, q_scratch_pool);
   } else {
-    all_ngh = qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points, Q_Base_Points, QueryStats, start_point, QP);
+    results = qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points, Q_Base_Points, QueryStats, starting_points, QP, q_scratch_pool);
   }
   query_time = t.next_time();
 
@@ -74,7 +83,7 @@ nn_result checkRecall(
     int numCorrect = 0;
     for (indexType i = 0; i < n; i++) {
       std::set<indexType> reported_nbhs;
-      for (indexType l = 0; l < k; l++) reported_nbhs.insert((all_ngh[i])[l]);
+      for (indexType l = 0; l < k; l++) reported_nbhs.insert(results.neighbors(i)[l]);
       for (indexType l = 0; l < k; l++) {
         if (reported_nbhs.find((GT.coordinates(i,l))) !=
             reported_nbhs.end()) {
@@ -86,37 +95,30 @@ nn_result checkRecall(
   } else if (GT.size() > 0 && dists_present) {
     size_t n = Query_Points.size();
 
+    // the searches return the distances of their results, so a result
+    // is correct if it is no further than the k-th nearest neighbor,
+    // which also counts the points tied with it
     int numCorrect = 0;
     for (indexType i = 0; i < n; i++) {
-      parlay::sequence<int> results_with_ties;
-      for (indexType l = 0; l < k; l++)
-        results_with_ties.push_back(GT.coordinates(i,l));
       Point qp = Query_Points[i];
       float last_dist = qp.distance(Base_Points[GT.coordinates(i, k-1)]);
       //float last_dist = GT.distances(i, k-1);
-      for (indexType l = k; l < GT.dimension(); l++) {
-        //if (GT.distances(i,l) == last_dist) {
-        if (qp.distance(Base_Points[GT.coordinates(i, l)]) == last_dist) {
-          results_with_ties.push_back(GT.coordinates(i,l));
-        }
-      }
-      std::set<int> reported_nbhs;
-      for (indexType l = 0; l < k; l++) reported_nbhs.insert((all_ngh[i])[l]);
-      for (indexType l = 0; l < results_with_ties.size(); l++) {
-        if (reported_nbhs.find(results_with_ties[l]) != reported_nbhs.end()) {
-          numCorrect += 1;
-        }
-      }
+      for (indexType l = 0; l < k; l++)
+        if (results.neighbor_distances(i)[l] <= last_dist) numCorrect += 1;
     }
     recall = static_cast<float>(numCorrect) / static_cast<float>(k * n);
   }
   float QPS = Query_Points.size() / query_time;
+  double hops = (double) parlay::reduce(results.hops) / std::max<size_t>(Query_Points.size(), 1);
   if (verbose)
     std::cout << "search: Q=" << QP.beamSize << ", k=" << QP.k
               << ", limit=" << QP.limit << ", dlimit=" << QP.degree_limit
+              << ", width=" << QP.beam_width
               << ", recall=" << recall
               << ", visited=" << QueryStats.visited_stats()[0]
+              << ", hops=" << hops
               << ", comparisons=" << QueryStats.dist_stats()[0]
+              << ", seen_skips=" << QueryStats.seen_skip_rate()
               << ", QPS=" << QPS << std::endl;
 
   auto stats_ = {QueryStats.dist_stats(), QueryStats.visited_stats()};
@@ -177,15 +179,32 @@ void search_and_parse(Graph_ G_,
                       QPointRange &Q_Query_Points, 
                       groundTruth<indexType> GT, char* res_file, long k,
                       bool random=true, indexType start_point=0,
-                      bool verbose=false) {
+                      bool verbose=false, long rerank_factor=5,
+                      long rerank_patience=0, long beam_width=1,
+                      long prefetch_distance=4, long patience=0,
+                      long route_entries=0) {
   parlay::sequence<nn_result> results;
   std::vector<long> beams;
   std::vector<long> allr;
   std::vector<double> cuts;
 
+  // searches start from the entry points saved with the graph, if any
+  parlay::sequence<indexType> starting_points = G.entry_points();
+  if (starting_points.size() == 0) starting_points = {start_point};
+  // and with route_entries, from the ones closest to each query
+  NavigationLayer<indexType> nav;
+  if (route_entries > 0 && (long) starting_points.size() > route_entries)
+    nav = NavigationLayer<indexType>(Base_Points, starting_points);
+
   QueryParams QP;
   QP.limit = (long) G.size();
   QP.degree_limit = (long) G.max_degree();
+  QP.rerank_factor = rerank_factor;
+  QP.rerank_patience = rerank_patience;
+  QP.beam_width = beam_width;
+  QP.prefetch_distance = prefetch_distance;
+  QP.patience = patience;
+  QP.route_entries = route_entries;
   beams = {10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 22, 24, 26, 28, 30, 32, 
           34, 36, 38, 40, 45, 50, 55, 60, 65, 70, 80, 90, 100, 120, 140, 160, 
           180, 200, 225, 250, 275, 300, 375, 500, 750, 1000}; 
@@ -201,7 +220,7 @@ void search_and_parse(Graph_ G_,
         for (float Q : beams){
           QP.beamSize = Q;
           if (Q > r){
-            results.push_back(checkRecall<Point, PointRange, QPointRange, indexType>(G, Base_Points, Query_Points, Q_Base_Points, Q_Query_Points, GT, random, start_point, r, QP, verbose));
+            results.push_back(checkRecall<Point, PointRange, QPointRange, indexType>(G, Base_Points, Query_Points, Q_Base_Points, Q_Query_Points, GT, random, starting_points, nav, r, QP, verbose));
           }
         }
       }
@@ -212,6 +231,12 @@ void search_and_parse(Graph_ G_,
       parlay::sequence<long> degree_limits = calculate_limits(G.max_degree());
       degree_limits.push_back(G.max_degree());
       QP = QueryParams(r, r, 1.35, (long) G.size(), (long) G.max_degree());
+      QP.rerank_factor = rerank_factor;
+      QP.rerank_patience = rerank_patience;
+      QP.beam_width = beam_width;
+      QP.prefetch_distance = prefetch_distance;
+      QP.patience = patience;
+      QP.route_entries = route_entries;
       for(long l : limits){
         QP.limit = l;
         QP.beamSize = std::max<long>(l, r);
@@ -220,12 +245,18 @@ void search_and_parse(Graph_ G_,
           results.push_back(checkRecall<Point, PointRange, QPointRange, indexType>(G,
                                                                                    Base_Points, Query_Points,
                                                                                    Q_Base_Points, Q_Query_Points,
-                                                                                   GT, random, start_point, r, QP, verbose));
+                                                                                   GT, random, starting_points, nav, r, QP, verbose));
           }
       }
       // check "best accuracy"
       QP = QueryParams((long) 100, (long) 1000, (double) 10.0, (long) G.size(), (long) G.max_degree());
-      results.push_back(checkRecall<Point, PointRange, QPointRange, indexType>(G, Base_Points, Query_Points, Q_Base_Points, Q_Query_Points, GT, random, start_point, r, QP, verbose));
+      QP.rerank_factor = rerank_factor;
+      QP.rerank_patience = rerank_patience;
+      QP.beam_width = beam_width;
+      QP.prefetch_distance = prefetch_distance;
+      QP.patience = patience;
+      QP.route_entries = route_entries;
+      results.push_back(checkRecall<Point, PointRange, QPointRange, indexType>(G, Base_Points, Query_Points, Q_Base_Points, Q_Query_Points, GT, random, starting_points, nav, r, QP, verbose));
 
     parlay::sequence<float> buckets =  {.1, .2, .3,  .4,  .5,  .6, .7, .75,  .8, .85,                                                                                            
                                         .9, .93, .95, .97, .98, .99, .995, .999, .9995, 
@@ -249,4 +280,119 @@ void search_and_parse(Graph_ G_,
                    res_file, k, random, start_point, verbose);
 }
 
+// Searches for the k nearest neighbors of each query among the points with
+// its label, both with a filtered search that starts from a medoid of the
+// points with the label and only moves through them, and by searching
+// without the filter and dropping the results with other labels, which is
+// all an unfiltered graph can do.  The recall of both is reported against
+// the exact filtered neighbors, overall and by the fraction of the points
+// with the label of the query, since post-filtering only finds the
+// neighbors of common labels.
+template<typename Point, typename PointRange, typename indexType>
+void filtered_search_and_parse(Graph<indexType> &G,
+                               PointRange &Base_Points,
+                               PointRange &Query_Points,
+                               const PointLabels &labels,
+                               const PointLabels &query_labels,
+                               const parlay::sequence<indexType> &starting_points,
+                               long k, long beam_width=1, long prefetch_distance=4,
+                               bool verbose=false) {
+  using distanceType = typename Point::distanceType;
+  using pid = std::pair<indexType, distanceType>;
+  if (k == 0) k = 10;
+  size_t n = Base_Points.size();
+  size_t nq = Query_Points.size();
+  auto by_label = labels.points_by_label<indexType>();
+  auto label_starts = label_medoids<indexType>(Base_Points, labels);
+  auto matching = [&] (size_t i) -> size_t {
+    auto l = query_labels[i];
+    return (long) l < labels.num_labels() ? by_label[l].size() : 0;};
 
+  // the exact nearest neighbors of each query with its label
+  parlay::internal::timer t;
+  auto truth = parlay::tabulate(nq, [&] (size_t i) {
+    parlay::sequence<indexType> result;
+    if (matching(i) == 0) return result;
+    auto &ids = by_label[query_labels[i]];
+    std::vector<pid> dists(ids.size());
+    for (size_t j = 0; j < ids.size(); j++)
+      dists[j] = pid(ids[j], Query_Points[i].distance(Base_Points[ids[j]]));
+    size_t m = std::min<size_t>(k, ids.size());
+    std::partial_sort(dists.begin(), dists.begin() + m, dists.end(),
+                      [] (pid a, pid b) {return a.second < b.second;});
+    for (size_t j = 0; j < m; j++) result.push_back(dists[j].first);
+    return result;}, 1);
+  std::cout << "filtered ground truth computed in " << t.next_time() << " seconds" << std::endl;
+
+  // queries are grouped by the fraction of the points with their label
+  std::vector<double> bounds = {.001, .01, .1};
+  std::vector<std::string> names = {"<0.1%", "0.1-1%", "1-10%", ">=10%"};
+  auto bucket = parlay::tabulate(nq, [&] (size_t i) {
+    double selectivity = (double) matching(i) / n;
+    return (long) (std::upper_bound(bounds.begin(), bounds.end(), selectivity) - bounds.begin());});
+
+  auto report = [&] (std::string mode, long Q, parlay::sequence<parlay::sequence<indexType>> &results,
+                     parlay::sequence<size_t> &dist_cmps, double time) {
+    auto recall = parlay::tabulate(nq, [&] (size_t i) {
+      if (truth[i].size() == 0) return 0.0;
+      size_t found = 0;
+      for (auto x : truth[i])
+        if (std::find(results[i].begin(), results[i].end(), x) != results[i].end()) found++;
+      return (double) found / truth[i].size();});
+    std::vector<double> sum(names.size(), 0.0), cmps(names.size(), 0.0);
+    std::vector<size_t> count(names.size(), 0);
+    for (size_t i = 0; i < nq; i++) {
+      if (truth[i].size() == 0) continue;
+      sum[bucket[i]] += recall[i];
+      cmps[bucket[i]] += dist_cmps[i];
+      count[bucket[i]]++;
+    }
+    size_t total = std::accumulate(count.begin(), count.end(), (size_t) 0);
+    std::cout << mode << ": Q=" << Q << ", k=" << k
+              << ", recall=" << std::accumulate(sum.begin(), sum.end(), 0.0) / std::max<size_t>(total, 1)
+              << ", comparisons=" << std::accumulate(cmps.begin(), cmps.end(), 0.0) / std::max<size_t>(total, 1)
+              << ", QPS=" << nq / time << std::endl;
+    if (verbose)
+      for (size_t b = 0; b < names.size(); b++)
+        if (count[b] > 0)
+          std::cout << "  selectivity " << names[b] << ": queries=" << count[b]
+                    << ", recall=" << sum[b] / count[b]
+                    << ", comparisons=" << cmps[b] / count[b] << std::endl;
+  };
+
+  auto &scratch_pool = SearchScratchPool<indexType, distanceType>::shared();
+  for (long Q : {10, 20, 50, 100, 200}) {
+    if (Q < k) continue;
+    parlay::sequence<parlay::sequence<indexType>> results(nq);
+    parlay::sequence<size_t> dist_cmps(nq, 0);
+
+    QueryParams QP(k, Q, 1.35, (long) G.size(), (long) G.max_degree());
+    QP.beam_width = beam_width;
+    QP.prefetch_distance = prefetch_distance;
+    t.next_time();
+    parlay::parallel_for(0, nq, [&] (size_t i) {
+      if (matching(i) == 0) return;
+      auto label = query_labels[i];
+      auto &scratch = scratch_pool.get();
+      dist_cmps[i] = filtered_beam_search<Point, PointRange, indexType>(
+        Query_Points[i], G, Base_Points, parlay::sequence<indexType>(1, label_starts[label]),
+        QP, scratch, LabelFilter{&labels, label});
+      for (size_t j = 0; j < scratch.frontier.size() && j < k; j++)
+        results[i].push_back(scratch.frontier[j].first);});
+    report("filtered search", Q, results, dist_cmps, t.next_time());
+
+    // the whole beam is kept, so that as many results as possible are
+    // left after filtering
+    QP.k = 0;
+    parlay::parallel_for(0, nq, [&] (size_t i) {
+      results[i].clear();
+      auto label = query_labels[i];
+      auto &scratch = scratch_pool.get();
+      dist_cmps[i] = beam_search<Point, PointRange, indexType>(
+        Query_Points[i], G, Base_Points, starting_points, QP, scratch);
+      for (auto c : scratch.frontier)
+        if (labels[c.first] == label && results[i].size() < k)
+          results[i].push_back(c.first);});
+    report("post-filtered search", Q, results, dist_cmps, t.next_time());
+  }
+}
@@ -38,18 +38,19 @@ void checkRangeRecall(
         Graph<indexType> &G,
         PointRange &Base_Points,
         PointRange &Query_Points,
-        RangeGroundTruth<indexType> GT,
+        RangeGroundTruth<indexType> &GT,
         RangeParams RP,
-        long start_point) {
+        parlay::sequence<indexType> &start_points) {
 
 
   parlay::sequence<parlay::sequence<indexType>> all_rr;
 
+  auto &scratch_pool = SearchScratchPool<indexType, typename Point::distanceType>::shared();
   parlay::internal::timer t;
   float query_time;
   stats<indexType> QueryStats(Query_Points.size());
  
-  all_rr = RangeSearch<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats, start_point, RP);
+  all_rr = RangeSearch<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats, start_points, RP, scratch_pool);
   query_time = t.next_time();
   
 
@@ -60,7 +61,6 @@ void checkRangeRecall(
 
     //since distances are exact, just have to cross-check number of results
     size_t n = Query_Points.size();
-    int numCorrect = 0;
     for (indexType i = 0; i < n; i++) {
       float num_reported_results = all_rr[i].size();
       float num_actual_results = GT[i].size();
@@ -73,21 +73,21 @@ void checkRangeRecall(
     float cumulative_recall = reported_results/total_results;
   
   float QPS = Query_Points.size() / query_time;
-  auto stats_ = {QueryStats.dist_stats(), QueryStats.visited_stats()};
   
   std::cout << "For ";
   RP.print();
-  std::cout << ", Pointwise Recall = " << pointwise_recall << ", Cumulative Recall = " << cumulative_recall << ", QPS = " << QPS << std::endl;
-  
-  
+  std::cout << ", Pointwise Recall = " << pointwise_recall << ", Cumulative Recall = " << cumulative_recall
+            << ", visited = " << QueryStats.visited_stats()[0]
+            << ", comparisons = " << QueryStats.dist_stats()[0]
+            << ", QPS = " << QPS << std::endl;
 }
 
 
 template<typename Point, typename PointRange, typename indexType>
 void range_search_wrapper(Graph<indexType> &G, PointRange &Base_Points,
    PointRange &Query_Points, 
-  RangeGroundTruth<indexType> GT, double rad,
-  indexType start_point=0){
+  RangeGroundTruth<indexType> &GT, double rad,
+  parlay::sequence<indexType> &start_points, bool beam_doubling = false){
 
   std::vector<long> beams;
 
@@ -95,9 +95,7 @@ void range_search_wrapper(Graph<indexType> &G, PointRange &Base_Points,
 
   for(long b: beams){
     RangeParams RP(rad, b);
-    checkRangeRecall<Point, PointRange, indexType>(G, Base_Points, Query_Points, GT, RP, start_point);
+    RP.beam_doubling = beam_doubling;
+    checkRangeRecall<Point, PointRange, indexType>(G, Base_Points, Query_Points, GT, RP, start_points);
   }
-  
-
-  
 }
@@ -0,0 +1,166 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "parlay/random.h"
+
+// Where searches of a graph start.  A search from an arbitrary vertex
+// spends its first hops just getting to the part of the graph near the
+// query, so as in DiskANN we start from an approximate medoid, the point
+// closest to the mean of the data, and optionally also from the points
+// closest to the centers of a few clusters of it.  Both work on the
+// coordinates of the points in Euclidean space, whatever the distance.
+
+// the mean of Points[ids[i]] for all i, summed over blocks of points in
+// parallel so that each point is only read once
+template<typename PointRange, typename Seq>
+std::vector<double> mean_point(const PointRange &Points, const Seq &ids) {
+  size_t n = ids.size();
+  long dims = Points.dimension();
+  size_t num_blocks = std::min<size_t>(1024, (n + 999) / 1000);
+  if (num_blocks == 0) return std::vector<double>(dims, 0.0);
+  size_t block_size = (n + num_blocks - 1) / num_blocks;
+  auto sums = parlay::tabulate(num_blocks, [&] (size_t b) {
+    std::vector<double> s(dims, 0.0);
+    size_t end = std::min(n, (b + 1) * block_size);
+    for (size_t i = b * block_size; i < end; i++) {
+      auto p = Points[ids[i]];
+      for (long j = 0; j < dims; j++) s[j] += (double) p[j];
+    }
+    return s;});
+  std::vector<double> mean(dims, 0.0);
+  for (auto &s : sums)
+    for (long j = 0; j < dims; j++) mean[j] += s[j];
+  for (long j = 0; j < dims; j++) mean[j] /= n;
+  return mean;
+}
+
+template<typename Point>
+double squared_distance_to(const Point &p, const std::vector<double> &c) {
+  double d = 0;
+  for (size_t j = 0; j < c.size(); j++) {
+    double x = (double) p[j] - c[j];
+    d += x * x;
+  }
+  return d;
+}
+
+// the index of the point among Points[ids[i]] closest to c
+template<typename indexType, typename PointRange, typename Seq>
+indexType closest_point(const PointRange &Points, const Seq &ids, const std::vector<double> &c) {
+  using dpair = std::pair<double, indexType>;
+  auto dists = parlay::delayed_tabulate(ids.size(), [&] (size_t i) {
+    return dpair(squared_distance_to(Points[ids[i]], c), (indexType) ids[i]);});
+  dpair none(std::numeric_limits<double>::max(), 0);
+  return parlay::reduce(dists, parlay::minimum<dpair>(none)).second;
+}
+
+template<typename indexType, typename PointRange>
+indexType closest_point(const PointRange &Points, const std::vector<double> &c) {
+  auto all = parlay::delayed_tabulate(Points.size(), [] (size_t i) {return i;});
+  return closest_point<indexType>(Points, all, c);
+}
+
+// the approximate medoid of Points[ids[i]] for all i
+template<typename indexType, typename PointRange, typename Seq>
+indexType approximate_medoid(const PointRange &Points, const Seq &ids) {
+  return closest_point<indexType>(Points, ids, mean_point(Points, ids));
+}
+
+template<typename indexType, typename PointRange>
+indexType approximate_medoid(const PointRange &Points) {
+  auto all = parlay::delayed_tabulate(Points.size(), [] (size_t i) {return i;});
+  return approximate_medoid<indexType>(Points, all);
+}
+
+// The points closest to the centers of K clusters of the data, found with
+// a few rounds of Lloyd's algorithm on a random sample of it.  Both the
+// clustering and the choice of the point closest to each center only look
+// at the sample, so this reads m = K * sample_per_center points rather
+// than the whole data.  Points closest to more than one center are only
+// returned once.
+template<typename indexType, typename PointRange>
+parlay::sequence<indexType> diverse_entry_points(const PointRange &Points, long K,
+                                                 long sample_per_center = 64,
+                                                 int rounds = 10) {
+  size_t n = Points.size();
+  if (K <= 0 || n == 0) return parlay::sequence<indexType>();
+  size_t m = std::min<size_t>(n, K * sample_per_center);
+  parlay::random_generator gen(0);
+  std::uniform_int_distribution<size_t> dis(0, n - 1);
+  auto sample = parlay::tabulate(m, [&] (size_t i) {
+    auto r = gen[i];
+    return dis(r);});
+  K = std::min<long>(K, m);
+
+  long dims = Points.dimension();
+  std::vector<std::vector<double>> centers(K, std::vector<double>(dims));
+  for (long c = 0; c < K; c++) {
+    auto p = Points[sample[c]];
+    for (long j = 0; j < dims; j++) centers[c][j] = (double) p[j];
+  }
+  // the center closest to sample point i and the squared distance to it
+  auto nearest_center = [&] (size_t i) {
+    auto p = Points[sample[i]];
+    long best = 0;
+    double best_d = std::numeric_limits<double>::max();
+    for (long c = 0; c < K; c++) {
+      double d = squared_distance_to(p, centers[c]);
+      if (d < best_d) {best_d = d; best = c;}
+    }
+    return std::pair<long, double>(best, best_d);};
+  for (int round = 0; round < rounds; round++) {
+    auto closest = parlay::tabulate(m, [&] (size_t i) {
+      return std::pair<long, size_t>(nearest_center(i).first, sample[i]);});
+    auto clusters = parlay::group_by_index(closest, K);
+    // an empty cluster keeps its old center
+    for (long c = 0; c < K; c++)
+      if (clusters[c].size() > 0) centers[c] = mean_point(Points, clusters[c]);
+  }
+
+  // the point of its cluster closest to each center, or of the whole
+  // sample for a center no sample point is closest to
+  using dpair = std::pair<double, indexType>;
+  dpair none(std::numeric_limits<double>::max(), 0);
+  auto assigned = parlay::tabulate(m, [&] (size_t i) {
+    auto [c, d] = nearest_center(i);
+    return std::pair<long, dpair>(c, dpair(d, (indexType) sample[i]));});
+  auto clusters = parlay::group_by_index(assigned, K);
+  parlay::sequence<indexType> result;
+  for (long c = 0; c < K; c++) {
+    indexType p = (clusters[c].size() > 0)
+      ? parlay::reduce(clusters[c], parlay::minimum<dpair>(none)).second
+      : closest_point<indexType>(Points, sample, centers[c]);
+    if (std::find(result.begin(), result.end(), p) == result.end())
+      result.push_back(p);
+  }
+  return result;
+}
@@ -24,12 +24,17 @@
 
 #include <algorithm>
 #include <iostream>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
 #include "parlay/internal/file_map.h"
 #include "../bench/parse_command_line.h"
 #include "NSGDist.h"
+#include "half.h"
 
 #include "types.h"
 // #include "common/time_loop.h"
@@ -50,13 +55,7 @@ float euclidian_distance_(const uint8_t *p, const uint8_t *q, unsigned d) {
 }
 
 float euclidian_distance(const uint8_t *p, const uint8_t *q, unsigned d) {
-  int32_t result = 0;
-  for (int i = 0; i < d; i++) {
-    int32_t qi = (int32_t) p[i];
-    int32_t pi = (int32_t) q[i];
-    result += (qi - pi) * (qi - pi);
-  }
-  return (float)result;
+  return efanna2e::l2_sqr_uint8(p, q, d);
 }
 
 float euclidian_distance(const uint16_t *p, const uint16_t *q, unsigned d) {
@@ -70,12 +69,7 @@ float euclidian_distance(const uint16_t *p, const uint16_t *q, unsigned d) {
 }
 
 float euclidian_distance(const int8_t *p, const int8_t *q, unsigned d) {
-  int result = 0;
-  for (int i = 0; i < d; i++) {
-    result += ((int32_t)((int16_t)q[i] - (int16_t)p[i])) *
-      ((int32_t)((int16_t)q[i] - (int16_t)p[i]));
-  }
-  return (float)result;
+  return efanna2e::l2_sqr_int8(p, q, d);
 }
 
 float euclidian_distance(const float *p, const float *q, unsigned d) {
@@ -83,20 +77,62 @@ float euclidian_distance(const float *p, const float *q, unsigned d) {
   return distfunc.compare(p, q, d);
 }
 
+float euclidian_distance(const float16 *p, const float16 *q, unsigned d) {
+  return efanna2e::l2_sqr_fp16((const uint16_t *) p, (const uint16_t *) q, d);
+}
+
+float euclidian_distance(const bfloat16 *p, const bfloat16 *q, unsigned d) {
+  return efanna2e::l2_sqr_bf16((const uint16_t *) p, (const uint16_t *) q, d);
+}
+
+// weighted by w, for points quantized with a scale per dimension
+template<typename T>
+float euclidian_distance(const T *p, const T *q, const float *w, unsigned d) {
+  return efanna2e::l2_sqr_weighted_scalar(p, q, w, d);
+}
+
+float euclidian_distance(const uint8_t *p, const uint8_t *q, const float *w, unsigned d) {
+  return efanna2e::l2_sqr_weighted_uint8(p, q, w, d);
+}
+
+float euclidian_distance(const uint16_t *p, const uint16_t *q, const float *w, unsigned d) {
+  return efanna2e::l2_sqr_weighted_uint16(p, q, w, d);
+}
+
 template<typename T, long range=(1l << sizeof(T)*8) - 1>
 struct Euclidian_Point {
   using distanceType = float;
 
+  // Quantization either uses one slope and offset for all dimensions, or
+  // gives each dimension its own (per_dim), in which case distances are
+  // weighted by 1/slope^2 in each dimension to bring them back to the
+  // original scale.
   struct parameters {
     float slope;
     int32_t offset;
     int dims;
+    // slopes, offsets (the value mapped to 0) and distance weights, dims
+    // of each, or null
+    std::shared_ptr<float[]> per_dim;
     parameters() : slope(0), offset(0), dims(0) {}
     parameters(int dims) : slope(0), offset(0), dims(dims) {}
     parameters(float min_val, float max_val, int dims)
       : slope(range / (max_val - min_val)),
         offset((int32_t) round(min_val * slope)),
         dims(dims) {}
+    parameters(const std::vector<float>& min_vals, const std::vector<float>& max_vals)
+      : slope(0), offset(0), dims(min_vals.size()),
+        per_dim(new float[3 * min_vals.size()]) {
+      for (int j = 0; j < dims; j++) {
+        float width = max_vals[j] - min_vals[j];
+        float s = width > 0 ? range / width : 1;
+        per_dim[j] = s;
+        per_dim[dims + j] = min_vals[j];
+        per_dim[2 * dims + j] = 1 / (s * s);
+      }
+    }
+    const float* weights() const {
+      return per_dim == nullptr ? nullptr : per_dim.get() + 2 * dims;}
   };
 
   static distanceType d_min() {return 0;}
@@ -104,34 +140,39 @@ struct Euclidian_Point {
   T operator[](long i) const {return *(values + i);}
 
   float distance(const Euclidian_Point& x) const {
-    return euclidian_distance(this->values, x.values, params.dims);
+    if constexpr (std::is_integral<T>::value)
+      if (weights != nullptr)
+        return euclidian_distance(this->values, x.values, weights, dims);
+    return euclidian_distance(this->values, x.values, dims);
   }
 
   void normalize() {
     double norm = 0.0;
-    for (int j = 0; j < params.dims; j++)
+    for (int j = 0; j < dims; j++)
       norm += values[j] * values[j];
     norm = std::sqrt(norm);
     if (norm == 0) norm = 1.0;
-    for (int j = 0; j < params.dims; j++)
+    for (int j = 0; j < dims; j++)
       values[j] = values[j] / norm;
   }
 
   void prefetch() const {
-    int l = (params.dims * sizeof(T) - 1)/64 + 1;
+    int l = (dims * sizeof(T) - 1)/64 + 1;
     for (int i=0; i < l; i++)
       __builtin_prefetch((char*) values + i* 64);
   }
 
   long id() const {return id_;}
 
-  Euclidian_Point() : values(nullptr), id_(-1), params(0) {}
+  Euclidian_Point() : values(nullptr), id_(-1), dims(0), weights(nullptr) {}
 
-  Euclidian_Point(T* values, long id, parameters params)
-    : values(values), id_(id), params(params) {}
+  // only the dimension and the weights are kept, so that building a point
+  // does not copy the parameters' shared arrays
+  Euclidian_Point(T* values, long id, const parameters& params)
+    : values(values), id_(id), dims(params.dims), weights(params.weights()) {}
 
   bool operator==(const Euclidian_Point& q) const {
-    for (int i = 0; i < params.dims; i++) {
+    for (int i = 0; i < dims; i++) {
       if (values[i] != q.values[i]) {
         return false;
       }
@@ -145,6 +186,16 @@ struct Euclidian_Point {
 
   template <typename Point>
   static void translate_point(T* values, const Point& p, const parameters& params) {
+    if (params.per_dim != nullptr) {
+      // values outside of the (possibly clipped) range are clamped
+      const float* slopes = params.per_dim.get();
+      const float* offsets = slopes + params.dims;
+      for (int j = 0; j < params.dims; j++) {
+        float r = std::round(((float) p[j] - offsets[j]) * slopes[j]);
+        values[j] = (T) std::min<float>(std::max<float>(r, 0), range);
+      }
+      return;
+    }
     float slope = params.slope;
     int32_t offset = params.offset;
     float min_val = std::floor(offset / slope);
@@ -187,9 +238,119 @@ struct Euclidian_Point {
     return parameters(min_val, max_val, dims);
   }
 
+  // Gives each dimension its own range.  With clip > 0, a dimension's
+  // range runs from its clip to its 1-clip quantile (estimated on a sample
+  // of the points) instead of from its min to its max, so that a few
+  // outliers do not waste most of the codes.
+  template <typename PR>
+  static parameters generate_parameters(const PR& pr, bool per_dimension, double clip = 0) {
+    if (!per_dimension) return generate_parameters(pr);
+    long n = pr.size();
+    int dims = pr.dimension();
+    long ns = std::min<long>(n, 100000);
+    auto sample = parlay::random_permutation<long>(n);
+    auto ranges = parlay::tabulate(dims, [&] (long j) {
+      if (clip > 0) {
+        auto column = parlay::sort(parlay::tabulate(ns, [&] (long i) {
+          return (float) pr[sample[i]][j];}));
+        return std::pair(column[(long) std::floor(clip * (ns - 1))],
+                         column[(long) std::ceil((1 - clip) * (ns - 1))]);
+      }
+      auto column = parlay::delayed_tabulate(n, [&] (long i) {return (float) pr[i][j];});
+      return std::pair(*parlay::min_element(column), *parlay::max_element(column));
+    }, 1);
+    std::vector<float> min_vals(dims), max_vals(dims);
+    for (int j = 0; j < dims; j++) std::tie(min_vals[j], max_vals[j]) = ranges[j];
+    auto widths = parlay::tabulate(dims, [&] (long j) {return max_vals[j] - min_vals[j];});
+    std::cout << "per-dimension scalar quantization: ranges from "
+              << *parlay::min_element(widths) << " to " << *parlay::max_element(widths)
+              << " wide" << (clip > 0 ? ", clipped at " + std::to_string(clip) : "") << std::endl;
+    return parameters(min_vals, max_vals);
+  }
+
+private:
+  T* values;
+  long id_;
+  int dims;
+  const float* weights;  // per dimension, or null
+};
+
+// Euclidean distance between float vectors computed from their inner
+// product, as ||x||^2 + ||q||^2 - 2<x,q>.  The squared norm of every vector
+// is cached by its PointRange (see cached_norm), and a point built outside a
+// range computes its own once when constructed, so each distance is a
+// single call to the inner product kernel shared with Mips_Point.  It loses
+// accuracy for points much closer to each other than to the origin.
+struct Euclidian_Norm_Point {
+  using T = float;
+  using distanceType = float;
+
+  struct parameters {
+    int dims;
+    const float* norms; // squared norms of the points of the range
+    parameters() : dims(0), norms(nullptr) {}
+    parameters(int dims) : dims(dims), norms(nullptr) {}
+  };
+
+  static distanceType d_min() {return 0;}
+  static bool is_metric() {return true;}
+  T operator[](long i) const {return *(values + i);}
+
+  float distance(const Euclidian_Norm_Point& x) const {
+    float d = sq_norm + x.sq_norm - 2 * efanna2e::dot(this->values, x.values, params.dims);
+    return std::max(d, 0.0f);
+  }
+
+  static float cached_norm(const T* values, int dims) {
+    return efanna2e::dot(values, values, dims);
+  }
+
+  void normalize() {
+    std::cout << "can't normalize a point with a cached norm" << std::endl;
+    abort();
+  }
+
+  void prefetch() const {
+    int l = (params.dims * sizeof(T) - 1)/64 + 1;
+    for (int i=0; i < l; i++)
+      __builtin_prefetch((char*) values + i* 64);
+  }
+
+  long id() const {return id_;}
+
+  Euclidian_Norm_Point() : values(nullptr), id_(-1), params(0), sq_norm(0) {}
+
+  Euclidian_Norm_Point(T* values, long id, parameters params)
+    : values(values), id_(id), params(params),
+      sq_norm(params.norms != nullptr && id >= 0 ? params.norms[id]
+                                                 : cached_norm(values, params.dims)) {}
+
+  bool operator==(const Euclidian_Norm_Point& q) const {
+    for (int i = 0; i < params.dims; i++) {
+      if (values[i] != q.values[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool same_as(const Euclidian_Norm_Point& q) const {
+    return values == q.values;
+  }
+
+  template <typename Point>
+  static void translate_point(T* values, const Point& p, const parameters& params) {
+    for (int j = 0; j < params.dims; j++) values[j] = (T) p[j];
+  }
+
+  template <typename PR>
+  static parameters generate_parameters(const PR& pr) {
+    return parameters(pr.dimension());}
+
   parameters params;
 
 private:
   T* values;
   long id_;
+  float sq_norm;
 };
@@ -0,0 +1,280 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "NSGDist.h"
+#include "graph.h"
+#include "pq_point.h"
+
+// Fast-scan search over 4-bit product quantization codes.
+//
+// Every vertex of the graph stores the codes of its neighbors right after
+// its edges (see Graph::allocate_aux), in blocks of 32 neighbors.  Within a
+// block, each subspace takes 16 bytes: the low nibbles hold the codes of
+// neighbors 0-15 and the high nibbles those of neighbors 16-31.  A query
+// has a lookup table of 16 one-byte distances per subspace, so the table
+// of a subspace fits in a register and pshufb looks up the codes of 16
+// neighbors at once.  Expanding a vertex then reads its neighborhood as one
+// contiguous block instead of fetching each neighbor's vector.
+//
+// The byte distances are the float distances of the subspace shifted by
+// their minimum and scaled so that their sum over all subspaces fits in
+// 16 bits.
+
+// Sums, for each of the 32 neighbors of a block, the table entries of
+// their codes in the M subspaces (M even).
+inline void fast_scan_block_scalar(const uint8_t* codes, const uint8_t* lut,
+                                   int M, uint16_t* out) {
+  for (int j = 0; j < 32; j++) out[j] = 0;
+  for (int m = 0; m < M; m++) {
+    const uint8_t* c = codes + m * 16;
+    const uint8_t* t = lut + m * 16;
+    for (int j = 0; j < 16; j++) {
+      out[j] += t[c[j] & 15];
+      out[j + 16] += t[c[j] >> 4];
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+inline __m128i fold_lanes_avx2(__m256i x) {
+  return _mm_add_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+}
+
+// Two subspaces are handled per iteration, one in each 128-bit lane.  The
+// looked up bytes are accumulated in 16 bits, separately for the even and
+// odd neighbors, and the lanes are added up at the end.
+__attribute__((target("avx2")))
+inline void fast_scan_block_avx2(const uint8_t* codes, const uint8_t* lut,
+                                 int M, uint16_t* out) {
+  __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i low_byte = _mm256_set1_epi16(0x00ff);
+  __m256i lo_even = _mm256_setzero_si256(), lo_odd = _mm256_setzero_si256();
+  __m256i hi_even = _mm256_setzero_si256(), hi_odd = _mm256_setzero_si256();
+  for (int m = 0; m < M; m += 2) {
+    __m256i c = _mm256_loadu_si256((const __m256i*) (codes + m * 16));
+    __m256i t = _mm256_loadu_si256((const __m256i*) (lut + m * 16));
+    __m256i lo = _mm256_shuffle_epi8(t, _mm256_and_si256(c, nibble));
+    __m256i hi = _mm256_shuffle_epi8(t, _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble));
+    lo_even = _mm256_add_epi16(lo_even, _mm256_and_si256(lo, low_byte));
+    lo_odd = _mm256_add_epi16(lo_odd, _mm256_srli_epi16(lo, 8));
+    hi_even = _mm256_add_epi16(hi_even, _mm256_and_si256(hi, low_byte));
+    hi_odd = _mm256_add_epi16(hi_odd, _mm256_srli_epi16(hi, 8));
+  }
+  __m128i le = fold_lanes_avx2(lo_even), lo = fold_lanes_avx2(lo_odd);
+  __m128i he = fold_lanes_avx2(hi_even), ho = fold_lanes_avx2(hi_odd);
+  _mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi16(le, lo));
+  _mm_storeu_si128((__m128i*) (out + 8), _mm_unpackhi_epi16(le, lo));
+  _mm_storeu_si128((__m128i*) (out + 16), _mm_unpacklo_epi16(he, ho));
+  _mm_storeu_si128((__m128i*) (out + 24), _mm_unpackhi_epi16(he, ho));
+}
+
+typedef void (*fast_scan_kernel_t)(const uint8_t*, const uint8_t*, int, uint16_t*);
+
+static const fast_scan_kernel_t fast_scan_block = efanna2e::select_kernel<fast_scan_kernel_t>(
+    fast_scan_block_avx2, fast_scan_block_avx2, fast_scan_block_scalar, fast_scan_block_scalar);
+
+struct FastScan_Point {
+  using distanceType = float;
+  static constexpr int num_centroids = 16;
+  static constexpr int block_size = 32;
+
+  struct parameters {
+    PQ_Point::parameters pq;
+    int padded_M;  // subspaces rounded up to even, as laid out in blocks
+    parameters() : padded_M(0) {}
+  };
+
+  static distanceType d_min() {return -std::numeric_limits<float>::max();}
+  bool is_metric() const {return params.pq.metric;}
+
+  float distance(const FastScan_Point& x) const {
+    if (lut != nullptr) return distance_from_sum(lookup(x.codes));
+    if (x.lut != nullptr) return x.distance_from_sum(x.lookup(codes));
+    return PQ_Point(codes, id_, params.pq).distance(PQ_Point(x.codes, x.id_, x.params.pq));
+  }
+
+  // for a query, its lookup table and the distance for a sum of entries
+  const uint8_t* table() const {return lut.get();}
+  float distance_from_sum(uint32_t sum) const {return bias + scale * (float) sum;}
+
+  void prefetch() const {
+    if (codes == nullptr) return;
+    int l = (params.pq.M - 1)/64 + 1;
+    for (int i=0; i < l; i++)
+      __builtin_prefetch((char*) codes + i * 64);
+  }
+
+  bool same_as(const FastScan_Point& q) const {
+    return codes != nullptr && codes == q.codes;
+  }
+
+  long id() const {return id_;}
+
+  FastScan_Point(const uint8_t* codes, long id, parameters params,
+                 std::shared_ptr<uint8_t[]> lut = nullptr, float bias = 0, float scale = 1)
+    : codes(codes), id_(id), params(params), lut(lut), bias(bias), scale(scale) {}
+
+  void normalize() {
+    std::cout << "can't normalize product quantized point" << std::endl;
+    abort();
+  }
+
+private:
+  uint32_t lookup(const uint8_t* c) const {
+    uint32_t sum = 0;
+    for (int m = 0; m < params.pq.M; m++) sum += lut[m * num_centroids + c[m]];
+    return sum;
+  }
+
+  const uint8_t* codes;  // one byte per subspace, for base points
+  long id_;
+  parameters params;
+  std::shared_ptr<uint8_t[]> lut;  // for queries, padded_M x 16
+  float bias;
+  float scale;
+};
+
+// A 4-bit product quantized range.  Like PQ_PointRange, it is built either
+// from base points, training the codebooks, or from queries and a trained
+// range.  Before searching, pack_neighborhoods has to copy the codes into
+// the graph, and it has to be called again if the edges change.
+struct FastScan_PointRange {
+  using Point = FastScan_Point;
+  using parameters = FastScan_Point::parameters;
+
+  FastScan_PointRange() : n(0) {}
+
+  template <typename PR>
+  FastScan_PointRange(const PR& pr, int M) : pq(pr, M, Point::num_centroids), n(pr.size()) {
+    params.pq = pq.params;
+    params.padded_M = M + (M & 1);
+  }
+
+  template <typename PR>
+  FastScan_PointRange(const PR& pr, const FastScan_PointRange& FS)
+    : params(FS.params), pq(FS.pq), n(pr.size()) {
+    dims = pr.dimension();
+    query_values = std::shared_ptr<float[]>(new float[n * dims]);
+    parlay::parallel_for(0, n, [&] (long i) {
+      auto p = pr[i];
+      for (int j = 0; j < dims; j++) query_values[i * dims + j] = (float) p[j];});
+  }
+
+  size_t size() const { return n; }
+  long dimension() const {return pq.dimension();}
+  unsigned int get_dims() const { return pq.dimension(); }
+
+  Point operator [] (long i) const {
+    if (i > n) {
+      std::cout << "ERROR: point index out of range: " << i << " from range " << n << ", " << std::endl;
+      abort();
+    }
+    if (query_values == nullptr) return Point(pq.code(i), i, params);
+    return query_point(query_values.get() + i * dims, i);
+  }
+
+  long neighborhood_code_bytes(long max_degree) const {
+    long blocks = (max_degree + Point::block_size - 1) / Point::block_size;
+    return blocks * params.padded_M * 16;
+  }
+
+  template <typename indexType>
+  void pack_neighborhoods(Graph<indexType>& G) const {
+    G.allocate_aux(neighborhood_code_bytes(G.max_degree()));
+    int M = params.pq.M;
+    parlay::parallel_for(0, G.size(), [&] (long i) {
+      uint8_t* out = G.aux(i);
+      auto nbhs = G[i];
+      for (long j = 0; j < nbhs.size(); j++) {
+        const uint8_t* c = pq.code(nbhs[j]);
+        uint8_t* block = out + (j / Point::block_size) * params.padded_M * 16;
+        int k = j % Point::block_size;
+        for (int m = 0; m < M; m++) {
+          if (k < 16) block[m * 16 + k] |= c[m];
+          else block[m * 16 + k - 16] |= c[m] << 4;
+        }
+      }
+    });
+  }
+
+  // distances from the query q to the first num_elts neighbors of vertex v
+  template <typename GT, typename indexType>
+  void scan_neighborhood(GT& G, indexType v, const Point& q, long num_elts,
+                         float* out) const {
+    const uint8_t* codes = G.aux(v);
+    uint16_t sums[Point::block_size];
+    for (long b = 0; b * Point::block_size < num_elts; b++) {
+      fast_scan_block(codes + b * params.padded_M * 16, q.table(), params.padded_M, sums);
+      long end = std::min<long>(num_elts, (b + 1) * Point::block_size);
+      for (long j = b * Point::block_size; j < end; j++)
+        out[j] = q.distance_from_sum(sums[j - b * Point::block_size]);
+    }
+  }
+
+  parameters params;
+
+private:
+  // quantizes the distances from v to the centroids into bytes, with a
+  // common scale chosen so that sums over all subspaces fit in 16 bits
+  Point query_point(const float* v, long i) const {
+    int M = params.pq.M;
+    int K = Point::num_centroids;
+    std::vector<float> table(M * K);
+    float bias = 0;
+    float range = 0;
+    for (int m = 0; m < M; m++) {
+      int width = params.pq.offsets[m+1] - params.pq.offsets[m];
+      const float* cm = params.pq.centroids + PQ_Point::num_centroids * params.pq.offsets[m];
+      for (int c = 0; c < K; c++)
+        table[m * K + c] = PQ_Point::sub_distance(v + params.pq.offsets[m], cm + c * width,
+                                                  width, params.pq.metric);
+      float mn = *std::min_element(table.begin() + m * K, table.begin() + (m + 1) * K);
+      float mx = *std::max_element(table.begin() + m * K, table.begin() + (m + 1) * K);
+      bias += mn;
+      range = std::max(range, mx - mn);
+      for (int c = 0; c < K; c++) table[m * K + c] -= mn;
+    }
+    int levels = std::min(255, 65535 / params.padded_M);
+    float scale = (range > 0) ? range / levels : 1;
+    auto lut = std::shared_ptr<uint8_t[]>(new uint8_t[params.padded_M * K]());
+    for (int j = 0; j < M * K; j++)
+      lut[j] = (uint8_t) std::min<float>(levels, std::round(table[j] / scale));
+    return Point(nullptr, i, params, lut, bias, scale);
+  }
+
+  PQ_PointRange pq;
+  size_t n;
+  int dims = 0;
+  std::shared_ptr<float[]> query_values;
+};
@@ -129,7 +129,7 @@ struct Graph{
   Graph(){}
 
   void allocate_graph(long maxDeg, size_t n) {
-    long cnt = n * (maxDeg + 1);
+    long cnt = n * stride();
     long num_bytes = cnt * sizeof(indexType);
     indexType* ptr = (indexType*) aligned_alloc(1l << 21, num_bytes);
     madvise(ptr, num_bytes, MADV_HUGEPAGE);
@@ -184,9 +184,9 @@ struct Graph{
         parlay::make_slice(edges_start, edges_end);
       indexType* gr = graph.get();
       parlay::parallel_for(g_floor, g_ceiling, [&] (size_t i){
-        gr[i * (maxDeg + 1)] = degrees[i];
+        gr[i * stride()] = degrees[i];
         for(size_t j = 0; j < degrees[i]; j++){
-          gr[i * (maxDeg + 1) + 1 + j] = edges[offsets[i] - total_size_read + j];
+          gr[i * stride() + 1 + j] = edges[offsets[i] - total_size_read + j];
         }
       });
       total_size_read += total_size_to_read;
@@ -194,6 +194,14 @@ struct Graph{
       delete[] edges_start;
     }
     delete[] degrees_start;
+
+    //the entry points follow the edges, if they were saved
+    indexType num_entries;
+    if (reader.read((char*)(&num_entries), sizeof(indexType))) {
+      entries = parlay::sequence<indexType>(num_entries);
+      reader.read((char*) entries.begin(), sizeof(indexType) * num_entries);
+      std::cout << "Detected " << num_entries << " entry points" << std::endl;
+    }
   }
 
   void save(char* oFile) {
@@ -221,6 +229,11 @@ struct Graph{
       writer.write((char*)data.begin(), data.size() * sizeof(indexType));
       index = ceiling;
     }
+    if (entries.size() > 0) {
+      indexType num_entries = entries.size();
+      writer.write((char*) &num_entries, sizeof(indexType));
+      writer.write((char*) entries.begin(), num_entries * sizeof(indexType));
+    }
     writer.close();
   }
 
@@ -229,15 +242,47 @@ struct Graph{
       std::cout << "ERROR: graph index out of range: " << i << std::endl;
       abort();
     }
-    return edgeRange<indexType>(graph.get() + i * (maxDeg + 1),
-                                graph.get() + (i + 1) * (maxDeg + 1),
+    return edgeRange<indexType>(graph.get() + i * stride(),
+                                graph.get() + i * stride() + maxDeg + 1,
                                 i);
   }
 
+  // Reserves bytes of extra space after the adjacency list of every
+  // vertex, e.g. for compressed copies of its neighbors' vectors, so they
+  // are read along with the edges.  The contents start zeroed and are not
+  // saved with the graph.
+  void allocate_aux(long bytes) {
+    std::shared_ptr<indexType[]> old = graph;
+    long old_stride = stride();
+    aux_words = (bytes + sizeof(indexType) - 1) / sizeof(indexType);
+    allocate_graph(maxDeg, n);
+    indexType* gr = graph.get();
+    parlay::parallel_for(0, n, [&] (size_t i) {
+      for (long j = 0; j < maxDeg + 1; j++)
+        gr[i * stride() + j] = old[i * old_stride + j];});
+  }
+
+  long aux_bytes() const {return aux_words * sizeof(indexType);}
+
+  uint8_t* aux(indexType i) {
+    return (uint8_t*) (graph.get() + i * stride() + maxDeg + 1);
+  }
+
+  // The vertices searches of the graph should start from, e.g. its
+  // medoid.  They are saved after the edges, so graph files without them
+  // are still read (and give no entry points).
+  const parlay::sequence<indexType>& entry_points() const {return entries;}
+
+  void set_entry_points(parlay::sequence<indexType> pts) {entries = std::move(pts);}
+
   ~Graph(){}
 
 private:
+  long stride() const {return maxDeg + 1 + aux_words;}
+
   size_t n;
   long maxDeg;
+  long aux_words = 0;
   std::shared_ptr<indexType[]> graph;
+  parlay::sequence<indexType> entries;
 };
@@ -0,0 +1,51 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+
+#include "NSGDist.h"
+
+// 2-byte floating point element types, for points stored at half the size of
+// float.  They only hold the bits: distances go through the fp16 and bf16
+// kernels in NSGDist.h, and values are converted to and from float
+// everywhere else.
+struct float16 {
+  uint16_t bits;
+  float16() : bits(0) {}
+  float16(float x) : bits(efanna2e::float_to_fp16(x)) {}
+  operator float() const { return efanna2e::fp16_to_float(bits); }
+};
+
+struct bfloat16 {
+  uint16_t bits;
+  bfloat16() : bits(0) {}
+  bfloat16(float x) : bits(efanna2e::float_to_bf16(x)) {}
+  operator float() const { return efanna2e::bf16_to_float(bits); }
+};
+
+// Type of the values in a .bin file holding points with elements of type T.
+// Half precision points are read from .fbin files and converted on load.
+template<typename T> struct bin_file_type { using type = T; };
+template<> struct bin_file_type<float16> { using type = float; };
+template<> struct bin_file_type<bfloat16> { using type = float; };
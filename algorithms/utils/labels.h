@@ -0,0 +1,123 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <utility>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "parlay/random.h"
+#include "entry_points.h"
+
+// One label per point (a tenant, a category, ...) for searches that only
+// return the points with the label of the query.  Labels are read from a
+// file laid out like the .bin point files, a header of the number of
+// points and a 1 as uint32s followed by the uint32 label of each point, or
+// generated at random with label l drawn with probability proportional to
+// 1/(l+1), so that a few labels are common and most are rare.
+struct PointLabels {
+  using label_type = uint32_t;
+
+  PointLabels() : labels_(0) {}
+
+  PointLabels(char* filename) : labels_(0) {
+    if (filename == NULL) {
+      n = 0;
+      return;
+    }
+    std::ifstream reader(filename);
+    if (!reader.is_open()) {
+      std::cout << "could not open label file " << filename << std::endl;
+      abort();
+    }
+    uint32_t num_points, d;
+    reader.read((char*)(&num_points), sizeof(uint32_t));
+    reader.read((char*)(&d), sizeof(uint32_t));
+    if (d != 1) {
+      std::cout << "label file " << filename << " should have one label per point, not "
+                << d << std::endl;
+      abort();
+    }
+    n = num_points;
+    labels = parlay::sequence<label_type>(n);
+    reader.read((char*)(labels.data()), sizeof(label_type) * n);
+    labels_ = parlay::reduce(labels, parlay::maxm<label_type>()) + 1;
+    std::cout << "Detected " << n << " labels over " << labels_ << " values" << std::endl;
+  }
+
+  PointLabels(size_t n, long num_labels, long seed = 0, bool skewed = true)
+    : n(n), labels_(num_labels) {
+    std::vector<double> cdf(num_labels);
+    double total = 0;
+    for (long l = 0; l < num_labels; l++) {
+      total += skewed ? 1.0 / (l + 1) : 1.0;
+      cdf[l] = total;
+    }
+    parlay::random_generator gen(seed);
+    std::uniform_real_distribution<double> dis(0, total);
+    labels = parlay::tabulate(n, [&] (size_t i) {
+      auto r = gen[i];
+      long l = std::upper_bound(cdf.begin(), cdf.end(), dis(r)) - cdf.begin();
+      return (label_type) std::min(l, num_labels - 1);});
+  }
+
+  size_t size() const {return n;}
+  long num_labels() const {return labels_;}
+  label_type operator[](size_t i) const {return labels[i];}
+
+  // the ids of the points with each label
+  template<typename indexType>
+  parlay::sequence<parlay::sequence<indexType>> points_by_label() const {
+    auto pairs = parlay::tabulate(n, [&] (size_t i) {
+      return std::pair<label_type, indexType>(labels[i], (indexType) i);});
+    return parlay::group_by_index(pairs, labels_);
+  }
+
+private:
+  size_t n = 0;
+  long labels_;
+  parlay::sequence<label_type> labels;
+};
+
+// the predicate a filtered beam search applies to each vertex
+struct LabelFilter {
+  const PointLabels* L;
+  PointLabels::label_type label;
+
+  template<typename indexType>
+  bool operator()(indexType i) const {return (*L)[i] == label;}
+};
+
+// an approximate medoid of the points with each label, where searches
+// for that label start (the first point is used for labels no point has)
+template<typename indexType, typename PointRange>
+parlay::sequence<indexType> label_medoids(const PointRange &Points, const PointLabels &L) {
+  auto groups = L.points_by_label<indexType>();
+  return parlay::map(groups, [&] (auto &ids) {
+    return ids.size() == 0 ? (indexType) 0 : approximate_medoid<indexType>(Points, ids);});
+}
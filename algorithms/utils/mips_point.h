@@ -30,6 +30,7 @@
 #include "parlay/internal/file_map.h"
 #include "../bench/parse_command_line.h"
 #include "NSGDist.h"
+#include "half.h"
 #include "types.h"
 
 #include <fcntl.h>
@@ -40,27 +41,23 @@
 
 
   float mips_distance(const uint8_t *p, const uint8_t *q, unsigned d) {
-    int result = 0;
-    for (int i = 0; i < d; i++) {
-      result += ((int32_t)q[i]) * ((int32_t)p[i]);
-    }
-    return -((float)result);
+    return -efanna2e::dot_uint8(p, q, d);
   }
 
   float mips_distance(const int8_t *p, const int8_t *q, unsigned d) {
-    int result = 0;
-    for (int i = 0; i < d; i++) {
-      result += ((int32_t)q[i]) * ((int32_t)p[i]);
-    }
-    return -((float)result);
+    return -efanna2e::dot_int8(p, q, d);
   }
 
   float mips_distance(const float *p, const float *q, unsigned d) {
-    float result = 0;
-    for (int i = 0; i < d; i++) {
-      result += (q[i]) * (p[i]);
-    }
-    return -result;
+    return -efanna2e::dot(p, q, d);
+  }
+
+  float mips_distance(const float16 *p, const float16 *q, unsigned d) {
+    return -efanna2e::dot_fp16((const uint16_t *) p, (const uint16_t *) q, d);
+  }
+
+  float mips_distance(const bfloat16 *p, const bfloat16 *q, unsigned d) {
+    return -efanna2e::dot_bf16((const uint16_t *) p, (const uint16_t *) q, d);
   }
 
 template<typename T>
@@ -152,12 +149,7 @@ struct Quantized_Mips_Point{
   T operator [] (long j) const {return *(values+j);}
 
   float distance(int8_t* p, int8_t* q) const {
-    int32_t result = 0;
-    for (int i = 0; i < params.dims; i++){
-      result += (int16_t) p[i] * (int16_t) q[i];
-    }
-    //return (float) (r * r - result);
-    return (float) -result;
+    return -efanna2e::dot_int8(p, q, params.dims);
   }
 
   float distance(int16_t* p, int16_t* q) const {
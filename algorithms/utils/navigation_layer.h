@@ -0,0 +1,74 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "NSGDist.h"
+
+// Picks where each search of a graph starts among its entry points (see
+// entry_points.h).  The coordinates of the entry points are copied as
+// floats into one contiguous table, so finding the ones closest to a query
+// is a linear scan with the SIMD L2 kernel rather than a cache miss on the
+// vector of every entry point, and the search then starts from just those
+// instead of from all of them.  Like the choice of the entry points it
+// works in Euclidean space whatever the distance, which is close enough to
+// decide where to start.
+template<typename indexType>
+struct NavigationLayer {
+  NavigationLayer() : dims(0) {}
+
+  template<typename PointRange>
+  NavigationLayer(const PointRange &Points, const parlay::sequence<indexType> &ids)
+    : ids(ids), dims(Points.dimension()), table(ids.size() * dims) {
+    parlay::parallel_for(0, ids.size(), [&] (size_t i) {
+      auto p = Points[ids[i]];
+      for (long j = 0; j < dims; j++) table[i * dims + j] = (float) p[j];});
+  }
+
+  size_t size() const {return ids.size();}
+
+  // the m entry points closest to p, closest first
+  template<typename Point>
+  parlay::sequence<indexType> route(const Point &p, long m) const {
+    std::vector<float> q(dims);
+    for (long j = 0; j < dims; j++) q[j] = (float) p[j];
+    std::vector<std::pair<float, indexType>> dists(ids.size());
+    for (size_t i = 0; i < ids.size(); i++)
+      dists[i] = {efanna2e::l2_sqr(q.data(), table.data() + i * dims, dims), ids[i]};
+    m = std::min<long>(m, ids.size());
+    std::partial_sort(dists.begin(), dists.begin() + m, dists.end());
+    parlay::sequence<indexType> closest(m);
+    for (long i = 0; i < m; i++) closest[i] = dists[i].second;
+    return closest;
+  }
+
+private:
+  parlay::sequence<indexType> ids;
+  long dims;
+  std::vector<float> table;
+};
@@ -25,12 +25,14 @@
 #include <sys/mman.h>
 #include <algorithm>
 #include <iostream>
+#include <type_traits>
 
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
 #include "parlay/internal/file_map.h"
 #include "../bench/parse_command_line.h"
 #include "types.h"
+#include "half.h"
 
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -46,7 +48,15 @@ long dim_round_up(long dim, long tp_size){
   else return ((qt+1)*64)/tp_size;
 }
 
-  
+// Point types that define a static cached_norm(values, dims) get it
+// computed once for every vector of a range when the range is built, and
+// find the results in params.norms, indexed by point id.
+template<typename Point, typename = void>
+struct caches_norms : std::false_type {};
+
+template<typename Point>
+struct caches_norms<Point, std::void_t<decltype(&Point::cached_norm)>> : std::true_type {};
+
 template<typename T_, class Point_>
 struct PointRange{
   using T = T_;
@@ -70,6 +80,7 @@ struct PointRange{
     T* vptr = values.get();
     parlay::parallel_for(0, n, [&] (long i) {
       Point::translate_point(vptr + i * aligned_dims, pr[i], params);});
+    compute_norms();
   }
 
   template <typename PR>
@@ -104,10 +115,11 @@ struct PointRange{
       while(index < n){
           size_t floor = index;
           size_t ceiling = index+BLOCK_SIZE <= n ? index+BLOCK_SIZE : n;
-          T* data_start = new T[(ceiling-floor)*dims];
-          reader.read((char*)(data_start), sizeof(T)*(ceiling-floor)*dims);
-          T* data_end = data_start + (ceiling-floor)*dims;
-          parlay::slice<T*, T*> data = parlay::make_slice(data_start, data_end);
+          using FT = typename bin_file_type<T>::type;
+          FT* data_start = new FT[(ceiling-floor)*dims];
+          reader.read((char*)(data_start), sizeof(FT)*(ceiling-floor)*dims);
+          FT* data_end = data_start + (ceiling-floor)*dims;
+          parlay::slice<FT*, FT*> data = parlay::make_slice(data_start, data_end);
           int data_bytes = dims*sizeof(T);
           parlay::parallel_for(floor, ceiling, [&] (size_t i){
             for (int j=0; j < dims; j++)
@@ -117,6 +129,7 @@ struct PointRange{
           delete[] data_start;
           index = ceiling;
       }
+      compute_norms();
   }
 
   size_t size() const { return n; }
@@ -134,7 +147,17 @@ struct PointRange{
   parameters params;
 
 private:
+  void compute_norms() {
+    if constexpr (caches_norms<Point>::value) {
+      norms = std::shared_ptr<float[]>(new float[n]);
+      parlay::parallel_for(0, n, [&] (long i) {
+        norms[i] = Point::cached_norm(values.get() + i * aligned_dims, dims);});
+      params.norms = norms.get();
+    }
+  }
+
   std::shared_ptr<T[]> values;
+  std::shared_ptr<float[]> norms;
   unsigned int dims;
   unsigned int aligned_dims;
   size_t n;
@@ -0,0 +1,322 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "parlay/random.h"
+#include "parlay/internal/get_time.h"
+
+// Product quantization.  The dimensions are split into M contiguous
+// subspaces and each subspace gets a codebook of (up to) 256 centroids,
+// trained with k-means on a sample of the points.  A point is stored as M
+// bytes, the index of its closest centroid in each subspace.
+//
+// A query is not encoded.  Instead it gets a lookup table holding its
+// distance to every centroid of every subspace, and its distance to an
+// encoded point is the sum of M table entries (asymmetric distance
+// computation, or ADC).  Distances are either squared Euclidean or
+// negated inner products, following the point type of the range that was
+// quantized.
+struct PQ_Point {
+  using distanceType = float;
+  static constexpr int num_centroids = 256;
+
+  struct parameters {
+    int dims;
+    int M;  // number of subspaces, i.e. bytes per point
+    bool metric;
+    const float* centroids;  // subspace m starts at centroids + 256*offsets[m]
+    const int* offsets;      // M+1 subspace boundaries
+    parameters() : dims(0), M(0), metric(true), centroids(nullptr), offsets(nullptr) {}
+  };
+
+  static distanceType d_min() {return -std::numeric_limits<float>::max();}
+  bool is_metric() const {return params.metric;}
+
+  // distance between a query and an encoded point, or between two encoded
+  // points (approximated by the distance between their centroids)
+  float distance(const PQ_Point& x) const {
+    if (table != nullptr) return lookup(x.codes, table.get(), params.M);
+    if (x.table != nullptr) return lookup(codes, x.table.get(), params.M);
+    float result = 0;
+    for (int m = 0; m < params.M; m++) {
+      int width = params.offsets[m+1] - params.offsets[m];
+      const float* cm = params.centroids + num_centroids * params.offsets[m];
+      result += sub_distance(cm + codes[m] * width, cm + x.codes[m] * width,
+                             width, params.metric);
+    }
+    return result;
+  }
+
+  static float lookup(const uint8_t* codes, const float* table, int M) {
+    float r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+    int m = 0;
+    for (; m + 4 <= M; m += 4) {
+      r0 += table[m * num_centroids + codes[m]];
+      r1 += table[(m + 1) * num_centroids + codes[m + 1]];
+      r2 += table[(m + 2) * num_centroids + codes[m + 2]];
+      r3 += table[(m + 3) * num_centroids + codes[m + 3]];
+    }
+    for (; m < M; m++) r0 += table[m * num_centroids + codes[m]];
+    return (r0 + r1) + (r2 + r3);
+  }
+
+  static float sub_distance(const float* p, const float* q, int width, bool metric) {
+    float result = 0;
+    if (metric) {
+      for (int j = 0; j < width; j++) result += (p[j] - q[j]) * (p[j] - q[j]);
+    } else {
+      for (int j = 0; j < width; j++) result -= p[j] * q[j];
+    }
+    return result;
+  }
+
+  void prefetch() const {
+    if (codes == nullptr) return;
+    int l = (params.M - 1)/64 + 1;
+    for (int i=0; i < l; i++)
+      __builtin_prefetch((char*) codes + i * 64);
+  }
+
+  bool same_as(const PQ_Point& q) const {
+    return codes != nullptr && codes == q.codes;
+  }
+
+  long id() const {return id_;}
+
+  PQ_Point(const uint8_t* codes, long id, parameters params,
+           std::shared_ptr<float[]> table = nullptr)
+    : codes(codes), id_(id), params(params), table(table) {}
+
+  void normalize() {
+    std::cout << "can't normalize product quantized point" << std::endl;
+    abort();
+  }
+
+private:
+  const uint8_t* codes;
+  long id_;
+  parameters params;
+  std::shared_ptr<float[]> table;  // only for queries, M x 256 distances
+};
+
+// A range of product quantized points.  It is either built from a base
+// PointRange, in which case it trains the codebooks and encodes every
+// point, or from a query PointRange and an already trained range, in
+// which case it keeps the queries at full precision and builds the lookup
+// table of a query when it is fetched.  Fewer than 256 centroids per
+// subspace can be asked for, e.g. 16 for 4-bit codes, but every code
+// still takes a byte.
+struct PQ_PointRange {
+  using Point = PQ_Point;
+  using parameters = PQ_Point::parameters;
+
+  static constexpr long max_training_points = 32768;
+  static constexpr int kmeans_iterations = 12;
+
+  PQ_PointRange() : n(0), dims(0), M(0), K(0) {}
+
+  template <typename PR>
+  PQ_PointRange(const PR& pr, int M, int K = Point::num_centroids)
+    : n(pr.size()), dims(pr.dimension()), M(M), K(K) {
+    if (M <= 0 || M > dims) {
+      std::cout << "Error: product quantization needs between 1 and "
+                << dims << " subspaces, got " << M << std::endl;
+      abort();
+    }
+    if (K <= 0 || K > Point::num_centroids) {
+      std::cout << "Error: product quantization needs between 1 and "
+                << Point::num_centroids << " centroids per subspace, got " << K << std::endl;
+      abort();
+    }
+    parlay::internal::timer t("PQ");
+    init_params(PR::Point::is_metric());
+
+    // copy a random sample of the points to train on
+    long ns = std::min<long>(n, max_training_points);
+    auto sample_ids = parlay::random_permutation<long>(n);
+    auto sample = parlay::sequence<float>(ns * dims);
+    parlay::parallel_for(0, ns, [&] (long i) {
+      auto p = pr[sample_ids[i]];
+      for (int j = 0; j < dims; j++) sample[i * dims + j] = (float) p[j];});
+
+    parlay::parallel_for(0, M, [&] (long m) {
+      train_subspace(sample, ns, m);}, 1);
+
+    // encode every point by its closest centroid in each subspace
+    long num_bytes = n * M;
+    uint8_t* ptr = (uint8_t*) aligned_alloc(1l << 21, num_bytes);
+    madvise(ptr, num_bytes, MADV_HUGEPAGE);
+    codes = std::shared_ptr<uint8_t[]>(ptr, std::free);
+    parlay::parallel_for(0, n, [&] (long i) {
+      auto p = pr[i];
+      std::vector<float> v(dims);
+      for (int j = 0; j < dims; j++) v[j] = (float) p[j];
+      for (int m = 0; m < M; m++) {
+        int width = offsets[m+1] - offsets[m];
+        codes[i * M + m] = (uint8_t) closest_centroid(v.data() + offsets[m], m, width);
+      }
+    });
+    std::cout << "product quantization: " << M << " subspaces, "
+              << num_centroids(ns) << " centroids per subspace, trained on "
+              << ns << " points in " << t.next_time() << " seconds" << std::endl;
+  }
+
+  // queries for the trained range PQ
+  template <typename PR>
+  PQ_PointRange(const PR& pr, const PQ_PointRange& PQ)
+    : params(PQ.params), n(pr.size()), dims(PQ.dims), M(PQ.M), K(PQ.K),
+      centroids(PQ.centroids), offsets(PQ.offsets) {
+    query_values = std::shared_ptr<float[]>(new float[n * dims]);
+    parlay::parallel_for(0, n, [&] (long i) {
+      auto p = pr[i];
+      for (int j = 0; j < dims; j++) query_values[i * dims + j] = (float) p[j];});
+  }
+
+  size_t size() const { return n; }
+  long dimension() const {return dims;}
+  unsigned int get_dims() const { return dims; }
+  int bytes_per_point() const {return M;}
+
+  // the code of base point i, one byte per subspace
+  const uint8_t* code(long i) const {return codes.get() + i * M;}
+
+  Point operator [] (long i) const {
+    if (i > n) {
+      std::cout << "ERROR: point index out of range: " << i << " from range " << n << ", " << std::endl;
+      abort();
+    }
+    if (query_values == nullptr) return Point(codes.get() + i * M, i, params);
+    return Point(nullptr, i, params, query_table(query_values.get() + i * dims));
+  }
+
+  parameters params;
+
+private:
+  void init_params(bool metric) {
+    offsets = std::shared_ptr<int[]>(new int[M + 1]);
+    for (int m = 0; m <= M; m++) offsets[m] = (long) m * dims / M;
+    centroids = std::shared_ptr<float[]>(new float[Point::num_centroids * dims]);
+    params.dims = dims;
+    params.M = M;
+    params.metric = metric;
+    params.centroids = centroids.get();
+    params.offsets = offsets.get();
+  }
+
+  int num_centroids(long num_samples) const {
+    return std::min<long>(K, num_samples);
+  }
+
+  const float* subspace_centroids(int m) const {
+    return centroids.get() + Point::num_centroids * offsets[m];
+  }
+
+  // index of the centroid of subspace m closest (in squared Euclidean
+  // distance, for either distance) to the width values at v
+  int closest_centroid(const float* v, int m, int width) const {
+    const float* cm = subspace_centroids(m);
+    int best = 0;
+    float best_dist = std::numeric_limits<float>::max();
+    for (int c = 0; c < num_centroids(n); c++) {
+      float d = Point::sub_distance(v, cm + c * width, width, true);
+      if (d < best_dist) {best_dist = d; best = c;}
+    }
+    return best;
+  }
+
+  // Lloyd's k-means on subspace m of the ns sampled points, which are
+  // stored contiguously in sample
+  void train_subspace(const parlay::sequence<float>& sample, long ns, int m) {
+    int width = offsets[m+1] - offsets[m];
+    int k = num_centroids(ns);
+    float* cm = centroids.get() + Point::num_centroids * offsets[m];
+    auto sub = [&] (long i) {return sample.begin() + i * dims + offsets[m];};
+
+    // start from k distinct sample points
+    for (int c = 0; c < k; c++)
+      for (int j = 0; j < width; j++) cm[c * width + j] = sub(c)[j];
+    for (int c = k; c < Point::num_centroids; c++)
+      for (int j = 0; j < width; j++) cm[c * width + j] = 0;
+
+    parlay::random_generator gen(m);
+    std::uniform_int_distribution<long> dis(0, ns - 1);
+    parlay::sequence<int> assignment(ns);
+    std::vector<double> sums(k * width);
+    std::vector<long> counts(k);
+    for (int iter = 0; iter < kmeans_iterations; iter++) {
+      parlay::parallel_for(0, ns, [&] (long i) {
+        assignment[i] = closest_centroid(&*sub(i), m, width);});
+      std::fill(sums.begin(), sums.end(), 0.0);
+      std::fill(counts.begin(), counts.end(), 0);
+      for (long i = 0; i < ns; i++) {
+        int c = assignment[i];
+        counts[c]++;
+        for (int j = 0; j < width; j++) sums[c * width + j] += sub(i)[j];
+      }
+      for (int c = 0; c < k; c++) {
+        // reseed empty clusters with a random sample point
+        if (counts[c] == 0) {
+          auto r = gen[iter * k + c];
+          long i = dis(r);
+          for (int j = 0; j < width; j++) cm[c * width + j] = sub(i)[j];
+        } else {
+          for (int j = 0; j < width; j++)
+            cm[c * width + j] = sums[c * width + j] / counts[c];
+        }
+      }
+    }
+  }
+
+  // distances from the query at v to every centroid of every subspace
+  std::shared_ptr<float[]> query_table(const float* v) const {
+    auto table = std::shared_ptr<float[]>(new float[M * Point::num_centroids]);
+    for (int m = 0; m < M; m++) {
+      int width = offsets[m+1] - offsets[m];
+      const float* cm = subspace_centroids(m);
+      for (int c = 0; c < Point::num_centroids; c++)
+        table[m * Point::num_centroids + c] =
+          Point::sub_distance(v + offsets[m], cm + c * width, width, params.metric);
+    }
+    return table;
+  }
+
+  size_t n;
+  int dims;
+  int M;
+  int K;  // centroids per subspace
+  std::shared_ptr<uint8_t[]> codes;
+  std::shared_ptr<float[]> centroids;
+  std::shared_ptr<int[]> offsets;
+  std::shared_ptr<float[]> query_values;
+};
@@ -161,6 +161,22 @@ struct BuildParams{
   bool verbose;
 
   bool quantize; // use quantization for build
+  bool quantize_per_dim = false; // give each dimension its own quantization range
+  double quantize_clip = 0; // clip quantization ranges to these quantiles
+  long pq_bytes = 0; // product quantize first pass of search (vamana)
+  bool fast_scan = false; // use 4-bit codes stored with the graph for pq
+  bool binary = false; // binary quantize first pass of search (vamana)
+  bool rotate = false; // randomly rotate before binary quantization
+  long rerank_factor = 5; // rerank this many times k candidates (vamana)
+  long rerank_patience = 0; // stop reranking once the top k is stable (vamana)
+  long beam_width = 1; // vertices expanded per step of search (vamana)
+  long prefetch_distance = 4; // neighbors prefetched ahead of search distances (vamana)
+  long patience = 0; // stop searching once the top k is stable (vamana)
+  long num_entry_points = 0; // also start searches at this many cluster centers (vamana)
+  long route_entries = 0; // start each search from this many of the entry points (vamana)
+  char* label_path = nullptr; // label of each point, for filtered search (vamana)
+  char* query_label_path = nullptr; // label of each query, for filtered search
+  long num_labels = 0; // generate random labels with this many values if none are given
   double radius; // for radius search
   double radius_2; // for radius search
   bool self;
@@ -211,6 +227,25 @@ struct QueryParams{
   long limit;
   long degree_limit;
   float pad = 1.0;
+  // when searching quantized points, the closest rerank_factor * k
+  // candidates are reranked with the full vectors; if rerank_patience > 0
+  // reranking stops once that many consecutive candidates leave the top k
+  // unchanged
+  long rerank_factor = 5;
+  long rerank_patience = 0;
+  // the number of closest unvisited vertices expanded together in each
+  // step, so that their neighbors are fetched and compared as one batch
+  long beam_width = 1;
+  // how many neighbors ahead of the distance computation their vectors
+  // are prefetched; 0 prefetches each one as soon as it is found
+  long prefetch_distance = 4;
+  // if patience > 0 the search stops once that many steps in a row have
+  // not changed its k closest points, instead of only once the whole
+  // frontier has been visited
+  long patience = 0;
+  // if route_entries > 0 and the graph has more entry points, the search
+  // starts from only the route_entries of them closest to the query
+  long route_entries = 0;
 
   QueryParams(long k, long Q, double cut, long limit, long dg) : k(k), beamSize(Q), cut(cut), limit(limit), degree_limit(dg) {}
 
@@ -221,13 +256,17 @@ struct QueryParams{
 struct RangeParams{
   double rad;
   long initial_beam;
+  // if the first beam search of a range search ends with its beam full of
+  // points within the radius, search again with twice the beam instead of
+  // searching the points within the radius from them
+  bool beam_doubling = false;
 
   RangeParams(double rad, long ib) : rad(rad), initial_beam(ib) {}
 
   RangeParams() {}
 
   void print(){
-    std::cout << "Beam: " << initial_beam;
+    std::cout << "Beam: " << initial_beam << (beam_doubling ? " (doubling)" : " (BFS)");
   }
 
 };
@@ -31,6 +31,8 @@
 #include "../utils/NSGDist.h"
 #include "../utils/point_range.h"
 #include "../utils/graph.h"
+#include "../utils/entry_points.h"
+#include "../utils/labels.h"
 #include "../utils/types.h"
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
@@ -50,16 +52,23 @@ struct knn_index {
   BuildParams BP;
   std::set<indexType> delete_set;
   indexType start_point;
+  parlay::sequence<indexType> entry_points;
+  // the label of each point if the graph is built for filtered search,
+  // and the point of each label where searches for it start
+  const PointLabels* labels = nullptr;
+  parlay::sequence<indexType> label_starts;
 
   knn_index(BuildParams &BP) : BP(BP) {}
 
   indexType get_start() { return start_point; }
 
+  void set_labels(const PointLabels &L) { labels = &L; }
+
   //robustPrune routine as found in DiskANN paper, with the exception
   //that the new candidate set is added to the field new_nbhs instead
   //of directly replacing the out_nbh of p
   std::pair<parlay::sequence<indexType>, long>
-  robustPrune(indexType p, parlay::sequence<pid>& cand,
+  robustPrune(indexType p, const std::vector<pid>& cand,
               GraphI &G, PR &Points, double alpha, bool add = true) {
     // add out neighbors of p to the candidate set.
     size_t out_size = G[p].size();
@@ -86,30 +95,52 @@ struct knn_index {
     std::vector<indexType> new_nbhs;
     new_nbhs.reserve(BP.R);
 
-    size_t candidate_idx = 0;
-
-    while (new_nbhs.size() < BP.R && candidate_idx < candidates.size()) {
-      // Don't need to do modifications.
-      int p_star = candidates[candidate_idx].first;
-      candidate_idx++;
-      if (p_star == p || p_star == -1) {
-        continue;
-      }
-
-      new_nbhs.push_back(p_star);
+    // adds the closest remaining candidates to new_nbhs until it has
+    // limit of them, removing those each one added makes redundant
+    auto prune = [&] (std::vector<pid> &candidates, size_t limit, size_t chosen) {
+      size_t candidate_idx = 0;
+
+      while (new_nbhs.size() < limit && candidate_idx < candidates.size()) {
+        // Don't need to do modifications.
+        int p_star = candidates[candidate_idx].first;
+        candidate_idx++;
+        if (p_star == p || p_star == -1) {
+          continue;
+        }
 
-      for (size_t i = candidate_idx; i < candidates.size(); i++) {
-        int p_prime = candidates[i].first;
-        if (p_prime != -1) {
-          distance_comps++;
-          distanceType dist_starprime = Points[p_star].distance(Points[p_prime]);
-          distanceType dist_pprime = candidates[i].second;
-          if (alpha * dist_starprime <= dist_pprime) {
-            candidates[i].first = -1;
+        // the first chosen were already added, but still prune the others
+        if (std::find(new_nbhs.begin(), new_nbhs.begin() + chosen, p_star) ==
+            new_nbhs.begin() + chosen)
+          new_nbhs.push_back(p_star);
+
+        for (size_t i = candidate_idx; i < candidates.size(); i++) {
+          int p_prime = candidates[i].first;
+          if (p_prime != -1) {
+            distance_comps++;
+            distanceType dist_starprime = Points[p_star].distance(Points[p_prime]);
+            distanceType dist_pprime = candidates[i].second;
+            if (alpha * dist_starprime <= dist_pprime) {
+              candidates[i].first = -1;
+            }
           }
         }
       }
+    };
+
+    // With labels, as in Stitched-Vamana, up to half of the edges first go
+    // to points with the label of p, pruned only among themselves, so that
+    // the points with each label stay connected even where the points
+    // closest to them have other labels.  The rest are pruned from all of
+    // the candidates as usual.
+    size_t same_label = 0;
+    if (labels != nullptr) {
+      std::vector<pid> same;
+      for (auto c : candidates)
+        if ((*labels)[c.first] == (*labels)[p]) same.push_back(c);
+      prune(same, BP.R / 2, 0);
+      same_label = new_nbhs.size();
     }
+    prune(candidates, BP.R, same_label);
 
     auto new_neighbors_seq = parlay::to_sequence(new_nbhs);
     return std::pair(new_neighbors_seq, distance_comps);
@@ -121,7 +152,7 @@ struct knn_index {
   robustPrune(indexType p, parlay::sequence<indexType> candidates,
               GraphI &G, PR &Points, double alpha, bool add = true){
 
-    parlay::sequence<pid> cc;
+    std::vector<pid> cc;
     long distance_comps = 0;
     cc.reserve(candidates.size()); // + size_of(p->out_nbh));
     for (size_t i=0; i<candidates.size(); ++i) {
@@ -141,11 +172,21 @@ struct knn_index {
       if (a.count(ngh[i]) == 0) candidates.push_back(ngh[i]);
   }
 
-  void set_start(){start_point = 0;}
+  // Searches start from an approximate medoid of the points, and if
+  // BP.num_entry_points > 0 also from the points closest to the centers of
+  // that many clusters of them.  With labels, the filtered searches of the
+  // build start from a medoid of the points with the label.
+  void set_start(PR &Points) {
+    start_point = approximate_medoid<indexType>(Points);
+    entry_points = {start_point};
+    for (indexType p : diverse_entry_points<indexType>(Points, BP.num_entry_points))
+      if (p != start_point) entry_points.push_back(p);
+    if (labels != nullptr) label_starts = label_medoids<indexType>(Points, *labels);
+  }
 
   void build_index(GraphI &G, PR &Points, stats<indexType> &BuildStats, bool sort_neighbors = true){
     std::cout << "Building graph..." << std::endl;
-    set_start();
+    set_start(Points);
     parlay::sequence<indexType> inserts = parlay::tabulate(Points.size(), [&] (size_t i){
 					    return static_cast<indexType>(i);});
     if (BP.single_batch != 0) {
@@ -179,6 +220,7 @@ struct knn_index {
                       return Points[i].distance(Points[j]) < Points[i].distance(Points[k]);};
         G[i].sort(less);});
     }
+    G.set_entry_points(entry_points);
   }
 
   void batch_insert(parlay::sequence<indexType> &inserts,
@@ -215,6 +257,8 @@ struct knn_index {
     t_beam.stop();
     t_bidirect.stop();
     t_prune.stop();
+    parlay::sequence<indexType> start_points = entry_points;
+    SearchScratchPool<indexType, distanceType> scratch_pool;
     while (count < m) {
       size_t floor;
       size_t ceiling;
@@ -241,16 +285,35 @@ struct knn_index {
 
       parlay::parallel_for(floor, ceiling, [&](size_t i) {
         size_t index = shuffled_inserts[i];
-        int sp = BP.single_batch ? i : start_point;
         QueryParams QP((long) 0, BP.L, (double) 0.0, (long) Points.size(), (long) G.max_degree());
-        auto [beam_visited, bs_distance_comps] =
-          beam_search<Point, PointRange, indexType>(Points[index], G, Points, sp, QP);
-        auto [beam, visited] = beam_visited;
+        auto &scratch = scratch_pool.get();
+        size_t bs_distance_comps;
+        if (BP.single_batch)
+          bs_distance_comps = beam_search<Point, PointRange, indexType>(
+            Points[index], G, Points, parlay::sequence<indexType>(1, i), QP, scratch);
+        else
+          bs_distance_comps = beam_search<Point, PointRange, indexType>(
+            Points[index], G, Points, start_points, QP, scratch);
+        auto &visited = scratch.visited;
         BuildStats.increment_dist(index, bs_distance_comps);
         BuildStats.increment_visited(index, visited.size());
+        BuildStats.increment_seen_skips(index, scratch.seen_skips);
 
         long rp_distance_comps;
-        std::tie(new_out_[i-floor], rp_distance_comps) = robustPrune(index, visited, G, Points, alpha);
+        if (labels != nullptr) {
+          // also search among the points with the label of this one, from
+          // their start, so that its candidates include them even if the
+          // label is rare around it, and prune the union of both
+          std::vector<pid> candidates(visited.begin(), visited.end());
+          auto label = (*labels)[index];
+          bs_distance_comps = filtered_beam_search<Point, PointRange, indexType>(
+            Points[index], G, Points, parlay::sequence<indexType>(1, label_starts[label]),
+            QP, scratch, LabelFilter{labels, label});
+          BuildStats.increment_dist(index, bs_distance_comps);
+          candidates.insert(candidates.end(), scratch.visited.begin(), scratch.visited.end());
+          std::tie(new_out_[i-floor], rp_distance_comps) = robustPrune(index, candidates, G, Points, alpha);
+        } else
+          std::tie(new_out_[i-floor], rp_distance_comps) = robustPrune(index, visited, G, Points, alpha);
         BuildStats.increment_dist(index, rp_distance_comps);
       });
       t_beam.stop();
@@ -28,6 +28,9 @@
 #include "../utils/parse_results.h"
 #include "../utils/mips_point.h"
 #include "../utils/euclidian_point.h"
+#include "../utils/pq_point.h"
+#include "../utils/binary_point.h"
+#include "../utils/fast_scan.h"
 #include "../utils/stats.h"
 #include "../utils/types.h"
 #include "../utils/graph.h"
@@ -36,28 +39,56 @@
 #include "parlay/primitives.h"
 #include "parlay/random.h"
 
-template<typename Point, typename PointRange, typename QPointRange, typename indexType>
+// The graph is built on B_Points, and searched on Q_Points before the
+// results are reranked on Points.
+template<typename Point, typename PointRange, typename QPointRange, typename BPointRange, typename indexType>
 void ANN_(Graph<indexType> &G, long k, BuildParams &BP,
           PointRange &Query_Points, QPointRange &Q_Query_Points,
           groundTruth<indexType> GT, char *res_file,
-          bool graph_built, PointRange &Points, QPointRange &Q_Points) {
+          bool graph_built, PointRange &Points, QPointRange &Q_Points,
+          BPointRange &B_Points) {
   parlay::internal::timer t("ANN");
 
   bool verbose = BP.verbose;
-  using findex = knn_index<QPointRange, indexType>;
+  using findex = knn_index<BPointRange, indexType>;
   findex I(BP);
   indexType start_point;
   double idx_time;
   stats<unsigned int> BuildStats(G.size());
+
+  // with labels, the graph is built and searched for filtered search
+  PointLabels labels, query_labels;
+  if (BP.label_path != nullptr) {
+    labels = PointLabels(BP.label_path);
+    query_labels = PointLabels(BP.query_label_path);
+  } else if (BP.num_labels > 0) {
+    std::cout << "generating " << BP.num_labels << " random labels" << std::endl;
+    labels = PointLabels(Points.size(), BP.num_labels);
+    // queries draw labels uniformly, to cover rare labels as well as common ones
+    query_labels = PointLabels(Query_Points.size(), BP.num_labels, 1, false);
+  }
+  bool filtered = labels.size() > 0;
+  if (filtered && (labels.size() != Points.size() || query_labels.size() != Query_Points.size())) {
+    std::cout << "Error: expected " << Points.size() << " point labels and "
+              << Query_Points.size() << " query labels, found " << labels.size()
+              << " and " << query_labels.size() << std::endl;
+    abort();
+  }
+  if (filtered) I.set_labels(labels);
+
   if(graph_built){
     idx_time = 0;
     start_point = 0;
   } else{
-    I.build_index(G, Q_Points, BuildStats);
+    I.build_index(G, B_Points, BuildStats);
     start_point = I.get_start();
     idx_time = t.next_time();
   }
-  std::cout << "start index = " << start_point << std::endl;
+  if (G.entry_points().size() > 0) start_point = G.entry_points()[0];
+  std::cout << "start index = " << start_point << " ("
+            << G.entry_points().size() << " entry points)" << std::endl;
+  if constexpr (scans_neighborhoods<QPointRange>::value)
+    Q_Points.pack_neighborhoods(G);
 
   std::string name = "Vamana";
   std::string params =
@@ -65,18 +96,28 @@ void ANN_(Graph<indexType> &G, long k, BuildParams &BP,
   auto [avg_deg, max_deg] = graph_stats_(G);
   auto vv = BuildStats.visited_stats();
   std::cout << "Average visited: " << vv[0] << ", Tail visited: " << vv[1]
-            << std::endl;
+            << ", Seen-skip rate: " << BuildStats.seen_skip_rate() << std::endl;
   Graph_ G_(name, params, G.size(), avg_deg, max_deg, idx_time);
   G_.print();
 
   long build_num_distances = parlay::reduce(parlay::map(BuildStats.distances,
                                                         [] (auto x) {return (long) x;}));
 
-  if(Query_Points.size() != 0) {
+  if(Query_Points.size() != 0 && filtered) {
+    parlay::sequence<indexType> starting_points = G.entry_points();
+    if (starting_points.size() == 0) starting_points = {start_point};
+    filtered_search_and_parse<Point, PointRange, indexType>(G, Points, Query_Points, labels,
+                                                            query_labels, starting_points, k,
+                                                            BP.beam_width, BP.prefetch_distance,
+                                                            verbose);
+  } else if(Query_Points.size() != 0) {
     search_and_parse<Point, PointRange, QPointRange, indexType>(G_, G, Points, Query_Points,
                                                                 Q_Points, Q_Query_Points, GT,
                                                                 res_file, k, false, start_point,
-                                                                verbose);
+                                                                verbose, BP.rerank_factor,
+                                                                BP.rerank_patience, BP.beam_width,
+                                                                BP.prefetch_distance, BP.patience,
+                                                                BP.route_entries);
   } else if (BP.self) {
     if (BP.range) {
       parlay::internal::timer t_range("range search time");
@@ -114,18 +155,41 @@ void ANN(Graph<indexType> &G, long k, BuildParams &BP,
       using QT = uint8_t;
       using QPoint = Euclidian_Point<QT>;
       using QPR = PointRange<QT, QPoint>;
-      QPR Q_Points(Points);  // quantized to one byte
+      QPR Q_Points(Points, QPoint::generate_parameters(Points, BP.quantize_per_dim,
+                                                       BP.quantize_clip));  // quantized to one byte
       QPR Q_Query_Points(Query_Points, Q_Points.params);
-      ANN_<Point, PointRange_, QPR, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points);
+      ANN_<Point, PointRange_, QPR, QPR, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points, Q_Points);
     } else {
       using QT = int8_t;
       using QPoint = Quantized_Mips_Point<QT>;
       using QPR = PointRange<QT, QPoint>;
       QPR Q_Points(Points);
       QPR Q_Query_Points(Query_Points, Q_Points.params);
-      ANN_<Point, PointRange_, QPR, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points);
+      ANN_<Point, PointRange_, QPR, QPR, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points, Q_Points);
     }
+  } else if (BP.pq_bytes > 0 && BP.fast_scan) {
+    std::cout << "product quantizing first pass of search to " << BP.pq_bytes
+              << " bytes of 4-bit codes, scanned with the graph" << std::endl;
+    using QPR = FastScan_PointRange;
+    QPR Q_Points(Points, 2 * BP.pq_bytes);
+    QPR Q_Query_Points(Query_Points, Q_Points);
+    ANN_<Point, PointRange_, QPR, PointRange_, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points, Points);
+  } else if (BP.pq_bytes > 0) {
+    // product quantized codes are too coarse to build on, so build on the
+    // full vectors and only use the codes for the first pass of search
+    std::cout << "product quantizing first pass of search to " << BP.pq_bytes << " bytes" << std::endl;
+    using QPR = PQ_PointRange;
+    QPR Q_Points(Points, BP.pq_bytes);
+    QPR Q_Query_Points(Query_Points, Q_Points);
+    ANN_<Point, PointRange_, QPR, PointRange_, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points, Points);
+  } else if (BP.binary) {
+    std::cout << "binary quantizing first pass of search"
+              << (BP.rotate ? " after a random rotation" : "") << std::endl;
+    using QPR = Binary_PointRange;
+    QPR Q_Points(Points, BP.rotate);
+    QPR Q_Query_Points(Query_Points, Q_Points);
+    ANN_<Point, PointRange_, QPR, PointRange_, indexType>(G, k, BP, Query_Points, Q_Query_Points, GT, res_file, graph_built, Points, Q_Points, Points);
   } else {
-    ANN_<Point, PointRange_, PointRange_, indexType>(G, k, BP, Query_Points, Query_Points, GT, res_file, graph_built, Points, Points);
+    ANN_<Point, PointRange_, PointRange_, PointRange_, indexType>(G, k, BP, Query_Points, Query_Points, GT, res_file, graph_built, Points, Points, Points);
   }
 }
@@ -6,7 +6,9 @@
 // #include "utils/types.h"
 #include "utils/euclidian_point.h"
 #include "utils/mips_point.h"
+#include "utils/cosine_point.h"
 #include "utils/point_range.h"
+#include "utils/blocked_distances.h"
 
 
 using pid = std::pair<int, float>;
@@ -17,35 +19,37 @@ parlay::sequence<parlay::sequence<pid>> compute_groundtruth(PointRange &B,
     unsigned d = B.dimension();
     size_t q = Q.size();
     size_t b = B.size();
-    auto answers = parlay::tabulate(q, [&] (size_t i){  
-        float topdist = B[0].d_min();   
-        int toppos;
-        parlay::sequence<pid> topk;
-        for(size_t j=0; j<b; j++){
-            // float dist = D->distance((Q[i].coordinates).begin(), (B[j].coordinates).begin(), d);
-            float dist = Q[i].distance(B[j]);
-            if(topk.size() < k){
-                if(dist > topdist){
-                    topdist = dist;   
-                    toppos = topk.size();
-                }
-                topk.push_back(std::make_pair((int) j, dist));
+    parlay::sequence<parlay::sequence<pid>> answers(q);
+    parlay::sequence<float> topdists(q, B[0].d_min());
+    parlay::sequence<int> topposs(q);
+    // queries are compared with the base points in tiles, so that each base
+    // point is read from memory once per tile of queries
+    blocked_distances(q, [&] (size_t i) {return Q[i];},
+                      b, [&] (size_t j) {return B[j];},
+                      [&] (size_t i, size_t j, float dist){
+        float &topdist = topdists[i];
+        int &toppos = topposs[i];
+        parlay::sequence<pid> &topk = answers[i];
+        if(topk.size() < k){
+            if(dist > topdist){
+                topdist = dist;   
+                toppos = topk.size();
             }
-            else if(dist < topdist){
-                float new_topdist=B[0].d_min();  
-                int new_toppos=0;
-                topk[toppos] = std::make_pair((int) j, dist);
-                for(size_t l=0; l<topk.size(); l++){
-                    if(topk[l].second > new_topdist){
-                        new_topdist = topk[l].second;
-                        new_toppos = (int) l;
-                    }
+            topk.push_back(std::make_pair((int) j, dist));
+        }
+        else if(dist < topdist){
+            float new_topdist=B[0].d_min();  
+            int new_toppos=0;
+            topk[toppos] = std::make_pair((int) j, dist);
+            for(size_t l=0; l<topk.size(); l++){
+                if(topk[l].second > new_topdist){
+                    new_topdist = topk[l].second;
+                    new_toppos = (int) l;
                 }
-                topdist = new_topdist;
-                toppos = new_toppos;
             }
+            topdist = new_topdist;
+            toppos = new_toppos;
         }
-        return topk;
     });
     std::cout << "Done computing groundtruth" << std::endl;
     return answers;
@@ -95,7 +99,7 @@ void write_ibin(parlay::sequence<parlay::sequence<pid>> &result, const std::stri
 int main(int argc, char* argv[]) {
   commandLine P(argc,argv,
   "[-base_path <b>] [-query_path <q>] "
-      "[-data_type <d>] [-k <k> ] [-dist_func <d>] [-gt_path <outfile>]");
+      "[-data_type <d>] [-k <k> ] [-dist_func <d>] [-gt_path <outfile>] [-cache_norms]");
 
   char* gFile = P.getOptionValue("-gt_path");
   char* qFile = P.getOptionValue("-query_path");
@@ -103,10 +107,11 @@ int main(int argc, char* argv[]) {
   char* vectype = P.getOptionValue("-data_type");
   char* dfc = P.getOptionValue("-dist_func");
   int k = P.getOptionIntValue("-k", 100);
+  bool cache_norms = P.getOption("-cache_norms");
 
   std::string df = std::string(dfc);
-  if(df != "Euclidian" && df != "mips"){
-    std::cout << "Error: invalid distance type: specify Euclidian or mips" << std::endl;
+  if(df != "Euclidian" && df != "mips" && df != "cosine"){
+    std::cout << "Error: invalid distance type: specify Euclidian, mips or cosine" << std::endl;
     abort();
   }
 
@@ -116,6 +121,11 @@ int main(int argc, char* argv[]) {
     abort();
   }
 
+  if(df == "cosine" && tp != "float"){
+    std::cout << "Error: cosine distance is only supported for float vectors" << std::endl;
+    abort();
+  }
+
   std::cout << "Computing the " << k << " nearest neighbors" << std::endl;
 
   int maxDeg = 0;
@@ -127,7 +137,12 @@ int main(int argc, char* argv[]) {
 
   if(tp == "float"){
     std::cout << "Detected float coordinates" << std::endl;
-    if(df == "Euclidian"){
+    if(df == "Euclidian" && cache_norms){
+      // distances from the cached norms of the points and inner products
+      PointRange<float, Euclidian_Norm_Point> B = PointRange<float, Euclidian_Norm_Point>(bFile);
+      PointRange<float, Euclidian_Norm_Point> Q = PointRange<float, Euclidian_Norm_Point>(qFile);
+      answers = compute_groundtruth<PointRange<float, Euclidian_Norm_Point>>(B, Q, k);
+    } else if(df == "Euclidian"){
       PointRange<float, Euclidian_Point<float>> B = PointRange<float, Euclidian_Point<float>>(bFile);
       PointRange<float, Euclidian_Point<float>> Q = PointRange<float, Euclidian_Point<float>>(qFile);
       answers = compute_groundtruth<PointRange<float, Euclidian_Point<float>>>(B, Q, k);
@@ -135,6 +150,10 @@ int main(int argc, char* argv[]) {
       PointRange<float, Mips_Point<float>> B = PointRange<float, Mips_Point<float>>(bFile);
       PointRange<float, Mips_Point<float>> Q = PointRange<float, Mips_Point<float>>(qFile);
       answers = compute_groundtruth<PointRange<float, Mips_Point<float>>>(B, Q, k);
+    } else if(df == "cosine"){
+      PointRange<float, Cosine_Point<float>> B = PointRange<float, Cosine_Point<float>>(bFile);
+      PointRange<float, Cosine_Point<float>> Q = PointRange<float, Cosine_Point<float>>(qFile);
+      answers = compute_groundtruth<PointRange<float, Cosine_Point<float>>>(B, Q, k);
     }
   }else if(tp == "uint8"){
     std::cout << "Detected uint8 coordinates" << std::endl;
@@ -76,6 +76,16 @@ template void build_vamana_index<uint8_t, Euclidian_Point<uint8_t>>(std::string
 template void build_vamana_index<uint8_t, Mips_Point<uint8_t>>(std::string , std::string &, std::string &, uint32_t, uint32_t,
                                           float, bool);
 
+template void build_vamana_index<float16, Euclidian_Point<float16>>(std::string , std::string &, std::string &, uint32_t, uint32_t,
+                                          float, bool);
+template void build_vamana_index<float16, Mips_Point<float16>>(std::string , std::string &, std::string &, uint32_t, uint32_t,
+                                          float, bool);
+
+template void build_vamana_index<bfloat16, Euclidian_Point<bfloat16>>(std::string , std::string &, std::string &, uint32_t, uint32_t,
+                                           float, bool);
+template void build_vamana_index<bfloat16, Mips_Point<bfloat16>>(std::string , std::string &, std::string &, uint32_t, uint32_t,
+                                           float, bool);
+
 
 
 template <typename T, typename Point>
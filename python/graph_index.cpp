@@ -47,6 +47,7 @@ struct GraphIndex{
     Graph<unsigned int> G;
     PointRange<T, Point> Points;
     std::optional<ANN::HNSW<Desc_HNSW<T, Point>>> HNSW_index;
+    parlay::sequence<unsigned int> starting_points = {0};
 
     GraphIndex(std::string &data_path, std::string &index_path, size_t num_points, size_t dimensions, bool is_hnsw=false){
         Points = PointRange<T, Point>(data_path.data());
@@ -63,10 +64,18 @@ struct GraphIndex{
         }
         else {
             G = Graph<unsigned int>(index_path.data());
+            if(G.entry_points().size() > 0) starting_points = G.entry_points();
         }
     }
 
-    auto search_dispatch(const Point &q, QueryParams &QP)
+    using Results = SearchResults<unsigned int, typename Point::distanceType>;
+    using ScratchPool = SearchScratchPool<unsigned int, typename Point::distanceType>;
+
+    // kept across calls so that the visited table of each worker is allocated once
+    ScratchPool scratch_pool;
+
+    // searches for q, leaving its results in row i of results
+    void search_dispatch(const Point &q, QueryParams &QP, size_t i, Results &results)
     {
         if(HNSW_index) {
             using indexType = unsigned int; // be consistent with the type of G
@@ -81,59 +90,61 @@ struct GraphIndex{
             ctrl.count_cmps = &dist_cmps;
 
             seq_t frontier = HNSW_index->search(q, QP.k, QP.beamSize, ctrl);
-            return pair(pair(std::move(frontier), seq_t{}), dist_cmps);
+            results.set(i, frontier.begin(), frontier.end());
+            results.dist_cmps[i] = dist_cmps;
+        }
+        else {
+            auto &scratch = scratch_pool.get();
+            size_t dist_cmps = beam_search<Point, PointRange<T, Point>, unsigned int>(q, G, Points, starting_points, QP, scratch);
+            results.set(i, scratch.frontier.begin(), scratch.frontier.end());
+            results.visited[i] = scratch.visited.size();
+            results.dist_cmps[i] = dist_cmps;
+            results.hops[i] = scratch.hops;
         }
-        else return beam_search<Point, PointRange<T, Point>, unsigned int>(q, G, Points, 0, QP);
     }
 
-    NeighborsAndDistances batch_search(py::array_t<T, py::array::c_style | py::array::forcecast> &queries, uint64_t num_queries, uint64_t knn,
+    // copies the tables of results into numpy arrays
+    NeighborsAndDistances to_numpy(const Results &results){
+        py::array_t<unsigned int> ids({results.n, results.k});
+        py::array_t<float> dists({results.n, results.k});
+        unsigned int *ids_data = ids.mutable_data();
+        float *dists_data = dists.mutable_data();
+        parlay::parallel_for(0, results.n * results.k, [&] (size_t j){
+            ids_data[j] = results.ids[j];
+            dists_data[j] = results.distances[j];
+        });
+        return std::make_pair(std::move(ids), std::move(dists));
+    }
+
+    // queries for half precision indices are passed as float arrays
+    using query_type = typename bin_file_type<T>::type;
+
+    NeighborsAndDistances batch_search(py::array_t<query_type, py::array::c_style | py::array::forcecast> &queries, uint64_t num_queries, uint64_t knn,
                         uint64_t beam_width, int64_t visit_limit = -1){
         if(visit_limit == -1) visit_limit = HNSW_index? 0: G.size();
         QueryParams QP(knn, beam_width, 1.35, visit_limit, HNSW_index?0:G.max_degree());
 
-        py::array_t<unsigned int> ids({num_queries, knn});
-        py::array_t<float> dists({num_queries, knn});
-
-
-        parlay::sequence<unsigned int> point_ids;
-        parlay::sequence<float> point_distances;
-
-        using parameters = typename Point::parameters;
+        Results results(num_queries, knn);
 
         parlay::parallel_for(0, num_queries, [&] (size_t i){
           std::vector<T> v(Points.dimension());
           for (int j=0; j < v.size(); j++)
             v[j] = queries.data(i)[j];
           Point q = Point(v.data(), i, Points.params); 
-            auto [pairElts, dist_cmps] = search_dispatch(q, QP);
-            auto [frontier, visited] = pairElts;
-            parlay::sequence<unsigned int> point_ids;
-            parlay::sequence<float> point_distances;
-            for(int j=0; j<knn; j++){
-                ids.mutable_data(i)[j] = frontier[j].first;
-                dists.mutable_data(i)[j] = frontier[j].second;
-            }
+            search_dispatch(q, QP, i, results);
         });
-        return std::make_pair(std::move(ids), std::move(dists));
+        return to_numpy(results);
     }
 
     NeighborsAndDistances batch_search_from_string(std::string &queries, uint64_t num_queries, uint64_t knn,
                                     uint64_t beam_width){
         QueryParams QP(knn, beam_width, 1.35, HNSW_index?0:G.size(), HNSW_index?0:G.max_degree());
         PointRange<T, Point> QueryPoints = PointRange<T, Point>(queries.data());
-        py::array_t<unsigned int> ids({num_queries, knn});
-        py::array_t<float> dists({num_queries, knn});
+        Results results(num_queries, knn);
         parlay::parallel_for(0, num_queries, [&] (size_t i){
-            auto [pairElts, dist_cmps] = search_dispatch(QueryPoints[i], QP);
-            auto [frontier, visited] = pairElts;
-            parlay::sequence<unsigned int> point_ids;
-            parlay::sequence<float> point_distances;
-            for(int j=0; j<knn; j++){
-                ids.mutable_data(i)[j] = frontier[j].first;
-                dists.mutable_data(i)[j] = frontier[j].second;
-            }
+            search_dispatch(QueryPoints[i], QP, i, results);
         });
-        return std::make_pair(std::move(ids), std::move(dists));
+        return to_numpy(results);
     }
 
     void check_recall(std::string &gFile, py::array_t<unsigned int, py::array::c_style | py::array::forcecast> &neighbors, int k){
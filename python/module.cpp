@@ -54,6 +54,12 @@ const Variant UInt8MipsVariant{"build_vamana_uint8_mips_index", "UInt8MipsIndex"
 const Variant Int8EuclidianVariant{"build_vamana_int8_euclidian_index", "Int8EuclidianIndex"};
 const Variant Int8MipsVariant{"build_vamana_int8_mips_index", "Int8MipsIndex"};
 
+const Variant Float16EuclidianVariant{"build_vamana_float16_euclidian_index", "Float16EuclidianIndex"};
+const Variant Float16MipsVariant{"build_vamana_float16_mips_index", "Float16MipsIndex"};
+
+const Variant BFloat16EuclidianVariant{"build_vamana_bfloat16_euclidian_index", "BFloat16EuclidianIndex"};
+const Variant BFloat16MipsVariant{"build_vamana_bfloat16_mips_index", "BFloat16MipsIndex"};
+
 template <typename T, typename Point> inline void add_variant(py::module_ &m, const Variant &variant)
 {
 
@@ -152,6 +158,10 @@ PYBIND11_MODULE(_ParlayANNpy, m)
     add_variant<uint8_t, Mips_Point<uint8_t>>(m, UInt8MipsVariant);
     add_variant<int8_t, Euclidian_Point<int8_t>>(m, Int8EuclidianVariant);
     add_variant<int8_t, Mips_Point<int8_t>>(m, Int8MipsVariant);
+    add_variant<float16, Euclidian_Point<float16>>(m, Float16EuclidianVariant);
+    add_variant<float16, Mips_Point<float16>>(m, Float16MipsVariant);
+    add_variant<bfloat16, Euclidian_Point<bfloat16>>(m, BFloat16EuclidianVariant);
+    add_variant<bfloat16, Mips_Point<bfloat16>>(m, BFloat16MipsVariant);
 
     add_hcnng_variant<float, Euclidian_Point<float>>(m, FloatEuclidianHCNNGVariant);
     add_hcnng_variant<float, Mips_Point<float>>(m, FloatMipsHCNNGVariant);
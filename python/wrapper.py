@@ -8,6 +8,10 @@ def build_vamana_index(metric, dtype, data_dir, index_dir, R, L, alpha, two_pass
             build_vamana_int8_euclidian_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
         elif dtype == 'float':
             build_vamana_float_euclidian_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
+        elif dtype == 'float16':
+            build_vamana_float16_euclidian_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
+        elif dtype == 'bfloat16':
+            build_vamana_bfloat16_euclidian_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
         else:
             raise Exception('Invalid data type ' + dtype)
     elif metric == 'mips':
@@ -17,6 +21,10 @@ def build_vamana_index(metric, dtype, data_dir, index_dir, R, L, alpha, two_pass
             build_vamana_int8_mips_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
         elif dtype == 'float':
             build_vamana_float_mips_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
+        elif dtype == 'float16':
+            build_vamana_float16_mips_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
+        elif dtype == 'bfloat16':
+            build_vamana_bfloat16_mips_index(metric, data_dir, index_dir, R, L, alpha, two_pass)
         else:
             raise Exception('Invalid data type ' + dtype)
     else:
@@ -101,6 +109,10 @@ def load_index(metric, dtype, data_dir, index_dir, n, d, hnsw=False):
             return Int8EuclidianIndex(data_dir, index_dir, n, d, hnsw)
         elif dtype == 'float':
             return FloatEuclidianIndex(data_dir, index_dir, n, d, hnsw)
+        elif dtype == 'float16':
+            return Float16EuclidianIndex(data_dir, index_dir, n, d, hnsw)
+        elif dtype == 'bfloat16':
+            return BFloat16EuclidianIndex(data_dir, index_dir, n, d, hnsw)
         else:
             raise Exception('Invalid data type')
     elif metric == 'mips':
@@ -110,6 +122,10 @@ def load_index(metric, dtype, data_dir, index_dir, n, d, hnsw=False):
             return Int8MipsIndex(data_dir, index_dir, n, d, hnsw)
         elif dtype == 'float':
             return FloatMipsIndex(data_dir, index_dir, n, d, hnsw)
+        elif dtype == 'float16':
+            return Float16MipsIndex(data_dir, index_dir, n, d, hnsw)
+        elif dtype == 'bfloat16':
+            return BFloat16MipsIndex(data_dir, index_dir, n, d, hnsw)
         else:
             raise Exception('Invalid data type')
     else:
@@ -33,6 +33,7 @@
 #include "utils/euclidian_point.h"
 #include "utils/point_range.h"
 #include "utils/mips_point.h"
+#include "utils/cosine_point.h"
 #include "utils/graph.h"
 
 //#include "vamana/index.h"
@@ -75,7 +76,8 @@ int main(int argc, char *argv[]) {
     commandLine P(argc, argv,
                   "[-a <alpha>] [-R <deg>] [-L <bm>]"
                   "[-graph_outfile <oF>] [-base_path <b>]"
-                  "[-dist_func <df>] [-num_passes <np>] <inFile>");
+                  "[-dist_func <df>] [-num_passes <np>] [-quantize_build]"
+                  "[-num_entry_points <e>] <inFile>");
 
     double alpha = P.getOptionDoubleValue("-alpha", 1.0);
     long R = P.getOptionIntValue("-R", 0);
@@ -90,44 +92,82 @@ int main(int argc, char *argv[]) {
     int num_passes = P.getOptionIntValue("-num_passes", 1);
     bool normalize = P.getOption("-normalize");
     int single_batch = P.getOptionIntValue("-single_batch", 0);
+    bool quantize_build = P.getOption("-quantize_build");
+    long num_entry_points = P.getOptionIntValue("-num_entry_points", 0);
+    if (num_entry_points < 0) P.badArgument();
 
     std::string df = std::string(dfc);
 
     BuildParams BP = BuildParams(R, L, alpha, num_passes, single_batch);
+    BP.num_entry_points = num_entry_points;
     long maxDeg = BP.max_degree();
 
-    if (df != "Euclidian" && df != "mips") {
-        std::cout << "Error: specify distance type Euclidian or mips" << std::endl;
+    if (df != "Euclidian" && df != "mips" && df != "cosine") {
+        std::cout << "Error: specify distance type Euclidian, mips or cosine" << std::endl;
         abort();
     }
 
-    if (df == "Euclidian") {
-        PointRange<float, Euclidian_Point<float>> Points = PointRange<float, Euclidian_Point<float>>(iFile);
-        if (normalize) {
-            std::cout << "normalizing data" << std::endl;
-            for (int i = 0; i < Points.size(); i++)
-                Points[i].normalize();
-        }
-        Graph<unsigned int> G = Graph<unsigned int>(maxDeg, Points.size());
-        using Point = Euclidian_Point<float>;
-        using PR = PointRange<float, Point>;
-        time_build_index<Point, PR, uint>(G, BP, Points,
-                                          oFile);
-
-    } else if (df == "mips") {
-        PointRange<float, Mips_Point<float>> Points = PointRange<float, Mips_Point<float>>(iFile);
-        if (normalize) {
-            std::cout << "normalizing data" << std::endl;
-            for (int i = 0; i < Points.size(); i++)
-                Points[i].normalize();
-        }
-        Graph<unsigned int> G = Graph<unsigned int>(maxDeg, Points.size());
-        using Point = Mips_Point<float>;
-        using PR = PointRange<float, Point>;
-        time_build_index<Point, PR, uint>(G, BP, Points,
-                                          oFile);
+    if (quantize_build && df != "Euclidian") {
+        std::cout << "Error: -quantize_build is only supported for Euclidian distance" << std::endl;
+        abort();
     }
 
+    // use distance kernels specialized for the dimension of the data when
+    // there are any, falling back to the generic ones otherwise
+    dispatch_fixed_dims(bin_file_dimension(iFile), [&](auto D) {
+        if (df == "Euclidian") {
+            using Point = Fixed_Euclidian_Point<float, decltype(D)::value>;
+            using PR = PointRange<float, Point>;
+            PR Points = PR(iFile);
+            if (normalize) {
+                std::cout << "normalizing data" << std::endl;
+                parlay::parallel_for(0, Points.size(), [&](long i) {
+                    Points[i].normalize();
+                });
+            }
+            Graph<unsigned int> G = Graph<unsigned int>(maxDeg, Points.size());
+            if (quantize_build) {
+                // build on points quantized to one byte, saving the
+                // quantization so the search can quantize the same way
+                std::cout << "quantizing build to 1 byte" << std::endl;
+                using QPoint = Euclidian_Point<uint8_t>;
+                using QPR = PointRange<uint8_t, QPoint>;
+                QPR Q_Points(Points, QPoint::generate_parameters(Points));
+                time_build_index<QPoint, QPR, uint>(G, BP, Q_Points,
+                                                    oFile);
+                if (oFile != NULL)
+                    Q_Points.params.save(quantization_file(oFile).c_str());
+            } else {
+                time_build_index<Point, PR, uint>(G, BP, Points,
+                                                  oFile);
+            }
+
+        } else if (df == "mips") {
+            using Point = Mips_Point<float, decltype(D)::value>;
+            using PR = PointRange<float, Point>;
+            PR Points = PR(iFile);
+            if (normalize) {
+                std::cout << "normalizing data" << std::endl;
+                parlay::parallel_for(0, Points.size(), [&](long i) {
+                    Points[i].normalize();
+                });
+            }
+            Graph<unsigned int> G = Graph<unsigned int>(maxDeg, Points.size());
+            time_build_index<Point, PR, uint>(G, BP, Points,
+                                              oFile);
+
+        } else if (df == "cosine") {
+            // the inverse norms of the points are cached when they are
+            // loaded, so -normalize is not needed
+            using Point = Cosine_Point<float, decltype(D)::value>;
+            using PR = PointRange<float, Point>;
+            PR Points = PR(iFile);
+            Graph<unsigned int> G = Graph<unsigned int>(maxDeg, Points.size());
+            time_build_index<Point, PR, uint>(G, BP, Points,
+                                              oFile);
+        }
+    });
+
     return 0;
 }
 
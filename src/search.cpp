@@ -33,6 +33,7 @@
 #include "utils/euclidian_point.h"
 #include "utils/point_range.h"
 #include "utils/mips_point.h"
+#include "utils/cosine_point.h"
 #include "utils/graph.h"
 
 //#include "vamana/index.h"
@@ -56,26 +57,69 @@ using uint = unsigned int;
 template<typename Point, typename PointRange, typename indexType>
 void time_search(PointRange &Points, Graph<indexType> &G, BuildParams &BP,
                  PointRange &Query_Points, long k,
-                 groundTruth<indexType> GT, char *res_file) {
+                 groundTruth<indexType> GT, RangeGroundTruth<indexType> &RGT, char *res_file) {
 
 
     time_loop(1, 0,
               [&]() {},
               [&]() {
-                  ANN_search<Point, PointRange, indexType>(Points, G, BP,
-                                                           Query_Points, k,
-                                                           GT, res_file);
+                  if (BP.radius > 0)
+                      ANN_range_search<Point, PointRange, indexType>(Points, G, BP, Query_Points, RGT);
+                  else
+                      ANN_search<Point, PointRange, indexType>(Points, G, BP,
+                                                               Query_Points, k,
+                                                               GT, res_file);
               },
               [&]() {});
 
 }
 
+template<typename Point, typename PointRange, typename QPointRange, typename indexType>
+void time_quantized_search(PointRange &Points, QPointRange &Q_Points, Graph<indexType> &G,
+                           BuildParams &BP, PointRange &Query_Points,
+                           QPointRange &Q_Query_Points, long k,
+                           groundTruth<indexType> GT, char *res_file) {
+
+
+    time_loop(1, 0,
+              [&]() {},
+              [&]() {
+                  ANN_quantized_search<Point, PointRange, QPointRange, indexType>(Points, Q_Points, G, BP,
+                                                                                  Query_Points, Q_Query_Points,
+                                                                                  k, GT, res_file);
+              },
+              [&]() {});
+
+}
+
+// the quantization parameters saved with the graph if it was built with
+// -quantize_build, and otherwise ones computed from Points
+template<typename QPoint, typename PointRange>
+typename QPoint::parameters quantization_parameters(PointRange &Points, char *gFile) {
+    std::string qFile = quantization_file(gFile);
+    if (!std::ifstream(qFile).good()) {
+        std::cout << "No quantization parameters found at " << qFile
+                  << ", computing them from the base points" << std::endl;
+        return QPoint::generate_parameters(Points);
+    }
+    auto params = QPoint::parameters::read(qFile.c_str());
+    if (params.dims != Points.dimension()) {
+        std::cout << "Error: quantization parameters are for dimension " << params.dims
+                  << ", base points have dimension " << Points.dimension() << std::endl;
+        abort();
+    }
+    return params;
+}
+
 int main(int argc, char *argv[]) {
     commandLine P(argc, argv,
                   "[-R <deg>] [-L <bm>] [-a <alpha>]"
                   "[-k <k> ]  [-gt_path <g>] [-query_path <qF>]"
                   "[-graph_path <gF>] [-res_path <rF>]" "[-num_passes <np>]"
-                  "[-dist_func <df>] [-base_path <b>] <inFile>");
+                  "[-dist_func <df>] [-base_path <b>] [-quantize <bits>]"
+                  "[-quantize_build] [-beam_width <w>] [-prefetch_distance <d>]"
+                  "[-patience <p>] [-route_entries <e>] [-rerank_factor <f>]"
+                  "[-rerank_patience <p>] [-radius <r>] [-beam_doubling] <inFile>");
 
     long R = P.getOptionIntValue("-R", 0);
     if (R < 0) P.badArgument();
@@ -96,53 +140,147 @@ int main(int argc, char *argv[]) {
     bool verbose = P.getOption("-verbose");
     bool normalize = P.getOption("-normalize");
     int single_batch = P.getOptionIntValue("-single_batch", 0);
+    int quantize = P.getOptionIntValue("-quantize", 0);
+    bool quantize_build = P.getOption("-quantize_build");
+    long beam_width = P.getOptionIntValue("-beam_width", 1);
+    if (beam_width < 1) P.badArgument();
+    long prefetch_distance = P.getOptionIntValue("-prefetch_distance", 4);
+    if (prefetch_distance < 0) P.badArgument();
+    long patience = P.getOptionIntValue("-patience", 0);
+    if (patience < 0) P.badArgument();
+    long route_entries = P.getOptionIntValue("-route_entries", 0);
+    if (route_entries < 0) P.badArgument();
+    long rerank_factor = P.getOptionIntValue("-rerank_factor", 5);
+    if (rerank_factor < 1) P.badArgument();
+    long rerank_patience = P.getOptionIntValue("-rerank_patience", 0);
+    if (rerank_patience < 0) P.badArgument();
+    double radius = P.getOptionDoubleValue("-radius", 0);
+    if (radius < 0) P.badArgument();
+    bool beam_doubling = P.getOption("-beam_doubling");
 
     std::string df = std::string(dfc);
 
     BuildParams BP = BuildParams(R, L, alpha, num_passes, verbose,
                                  single_batch);
+    BP.beam_width = beam_width;
+    BP.prefetch_distance = prefetch_distance;
+    BP.patience = patience;
+    BP.route_entries = route_entries;
+    BP.rerank_factor = rerank_factor;
+    BP.rerank_patience = rerank_patience;
+    BP.radius = radius;
+    BP.beam_doubling = beam_doubling;
 
-    if (df != "Euclidian" && df != "mips") {
-        std::cout << "Error: specify distance type Euclidian or mips" << std::endl;
+    if (df != "Euclidian" && df != "mips" && df != "cosine") {
+        std::cout << "Error: specify distance type Euclidian, mips or cosine" << std::endl;
         abort();
     }
 
-    groundTruth<uint> GT = groundTruth<uint>(cFile);
-
-    if (df == "Euclidian") {
-        PointRange<float, Euclidian_Point<float>> Points = PointRange<float, Euclidian_Point<float>>(iFile);
-        PointRange<float, Euclidian_Point<float>> Query_Points = PointRange<float, Euclidian_Point<float>>(qFile);
-        if (normalize) {
-            std::cout << "normalizing data" << std::endl;
-            for (int i = 0; i < Points.size(); i++)
-                Points[i].normalize();
-            for (int i = 0; i < Query_Points.size(); i++)
-                Query_Points[i].normalize();
-        }
-        Graph<unsigned int> G = Graph<unsigned int>(gFile);
-        using Point = Euclidian_Point<float>;
-        using PR = PointRange<float, Point>;
-        time_search<Point, PR, uint>(Points, G, BP,
-                                     Query_Points, k,
-                                     GT, rFile);
-
-    } else if (df == "mips") {
-        PointRange<float, Mips_Point<float>> Points = PointRange<float, Mips_Point<float>>(iFile);
-        PointRange<float, Mips_Point<float>> Query_Points = PointRange<float, Mips_Point<float>>(qFile);
-        if (normalize) {
-            std::cout << "normalizing data" << std::endl;
-            for (int i = 0; i < Points.size(); i++)
-                Points[i].normalize();
-            for (int i = 0; i < Query_Points.size(); i++)
-                Query_Points[i].normalize();
-        }
-        Graph<unsigned int> G = Graph<unsigned int>(gFile);
-        using Point = Mips_Point<float>;
-        using PR = PointRange<float, Point>;
-        time_search<Point, PR, uint>(Points, G, BP,
-                                     Query_Points, k,
-                                     GT, rFile);
+    if (quantize != 0 && quantize != 8 && quantize != 16) {
+        std::cout << "Error: -quantize takes 8 or 16 bits" << std::endl;
+        abort();
+    }
+
+    if ((quantize != 0 || quantize_build) && df != "Euclidian") {
+        std::cout << "Error: quantization is only supported for Euclidian distance" << std::endl;
+        abort();
+    }
+
+    if (radius > 0 && (quantize != 0 || quantize_build)) {
+        std::cout << "Error: range search is not supported with quantization" << std::endl;
+        abort();
     }
 
+    // with -radius, the ground truth at -gt_path holds the points within
+    // the radius of each query instead of its nearest neighbors
+    groundTruth<uint> GT = groundTruth<uint>(radius > 0 ? nullptr : cFile);
+    RangeGroundTruth<uint> RGT = RangeGroundTruth<uint>(radius > 0 ? cFile : nullptr);
+
+    // use distance kernels specialized for the dimension of the data when
+    // there are any, falling back to the generic ones otherwise
+    dispatch_fixed_dims(bin_file_dimension(iFile), [&](auto D) {
+        if (df == "Euclidian") {
+            using Point = Fixed_Euclidian_Point<float, decltype(D)::value>;
+            using PR = PointRange<float, Point>;
+            PR Points = PR(iFile);
+            PR Query_Points = PR(qFile);
+            if (normalize) {
+                std::cout << "normalizing data" << std::endl;
+                parlay::parallel_for(0, Points.size(), [&](long i) {
+                    Points[i].normalize();
+                });
+                parlay::parallel_for(0, Query_Points.size(), [&](long i) {
+                    Query_Points[i].normalize();
+                });
+            }
+            Graph<unsigned int> G = Graph<unsigned int>(gFile);
+            if (quantize_build) {
+                // search the one byte points the graph was built on, then
+                // rerank with the full points
+                std::cout << "quantizing first pass of search to 1 byte" << std::endl;
+                using QPoint = Euclidian_Point<uint8_t>;
+                using QPR = PointRange<uint8_t, QPoint>;
+                QPR Q_Points(Points, quantization_parameters<QPoint>(Points, gFile));
+                QPR Q_Query_Points(Query_Points, Q_Points.params);
+                time_quantized_search<Point, PR, QPR, uint>(Points, Q_Points, G, BP,
+                                                            Query_Points, Q_Query_Points, k,
+                                                            GT, rFile);
+            } else if (quantize == 8) {
+                std::cout << "quantizing data to 1 byte" << std::endl;
+                using QPoint = Euclidian_Point<uint8_t>;
+                using QPR = PointRange<uint8_t, QPoint>;
+                QPR Q_Points(Points, quantization_parameters<QPoint>(Points, gFile));
+                QPR Q_Query_Points(Query_Points, Q_Points.params);
+                time_search<QPoint, QPR, uint>(Q_Points, G, BP,
+                                               Q_Query_Points, k,
+                                               GT, RGT, rFile);
+            } else if (quantize == 16) {
+                std::cout << "quantizing data to 2 bytes" << std::endl;
+                using QPoint = Euclidian_Point<uint16_t>;
+                using QPR = PointRange<uint16_t, QPoint>;
+                QPR Q_Points(Points, QPoint::generate_parameters(Points));
+                QPR Q_Query_Points(Query_Points, Q_Points.params);
+                time_search<QPoint, QPR, uint>(Q_Points, G, BP,
+                                               Q_Query_Points, k,
+                                               GT, RGT, rFile);
+            } else {
+                time_search<Point, PR, uint>(Points, G, BP,
+                                             Query_Points, k,
+                                             GT, RGT, rFile);
+            }
+
+        } else if (df == "mips") {
+            using Point = Mips_Point<float, decltype(D)::value>;
+            using PR = PointRange<float, Point>;
+            PR Points = PR(iFile);
+            PR Query_Points = PR(qFile);
+            if (normalize) {
+                std::cout << "normalizing data" << std::endl;
+                parlay::parallel_for(0, Points.size(), [&](long i) {
+                    Points[i].normalize();
+                });
+                parlay::parallel_for(0, Query_Points.size(), [&](long i) {
+                    Query_Points[i].normalize();
+                });
+            }
+            Graph<unsigned int> G = Graph<unsigned int>(gFile);
+            time_search<Point, PR, uint>(Points, G, BP,
+                                         Query_Points, k,
+                                         GT, RGT, rFile);
+
+        } else if (df == "cosine") {
+            // the inverse norms of the points are cached when they are
+            // loaded, so -normalize is not needed
+            using Point = Cosine_Point<float, decltype(D)::value>;
+            using PR = PointRange<float, Point>;
+            PR Points = PR(iFile);
+            PR Query_Points = PR(qFile);
+            Graph<unsigned int> G = Graph<unsigned int>(gFile);
+            time_search<Point, PR, uint>(Points, G, BP,
+                                         Query_Points, k,
+                                         GT, RGT, rFile);
+        }
+    });
+
     return 0;
 }
@@ -24,223 +24,391 @@ namespace efanna2e {
         L2 = 0, INNER_PRODUCT = 1, FAST_L2 = 2, PQ = 3
     };
 
-    class Distance {
-    public:
-        virtual float compare(const float *a, const float *b,
-                              unsigned length) const = 0;
-
-        virtual ~Distance() {}
+    // SIMD level of the machine we are running on.  Each kernel family below
+    // is resolved from it once at startup, so a single binary can run on hosts
+    // with and without AVX-512 regardless of the -march flags it was built with.
+    enum SimdLevel {
+        SIMD_SCALAR = 0, SIMD_SSE = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3
     };
 
-    class DistanceL2 : public Distance {
-    public:
-        float compare(const float *a, const float *b, unsigned size) const {
-            float result = 0;
+    inline SimdLevel detect_simd_level() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SIMD_AVX2;
+        if (__builtin_cpu_supports("sse2")) return SIMD_SSE;
+        return SIMD_SCALAR;
+    }
+
+    // picks the kernel matching the SIMD level out of a family of kernels
+    template<typename Kernel>
+    Kernel select_kernel(Kernel avx512, Kernel avx2, Kernel sse, Kernel scalar) {
+        switch (detect_simd_level()) {
+            case SIMD_AVX512:
+                return avx512;
+            case SIMD_AVX2:
+                return avx2;
+            case SIMD_SSE:
+                return sse;
+            default:
+                return scalar;
+        }
+    }
+
+    inline float l2_sqr_scalar(const float *a, const float *b, unsigned size) {
+        float result = 0;
+        float diff0, diff1, diff2, diff3;
+        const float *last = a + size;
+        const float *unroll_group = last - 3;
+
+        /* Process 4 items with each loop for efficiency. */
+        while (a < unroll_group) {
+            diff0 = a[0] - b[0];
+            diff1 = a[1] - b[1];
+            diff2 = a[2] - b[2];
+            diff3 = a[3] - b[3];
+            result += diff0 * diff0 + diff1 * diff1 + diff2 * diff2 + diff3 * diff3;
+            a += 4;
+            b += 4;
+        }
+        /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
+        while (a < last) {
+            diff0 = *a++ - *b++;
+            result += diff0 * diff0;
+        }
+        return result;
+    }
+
+    inline float l2_sqr_sse(const float *a, const float *b, unsigned size) {
+        __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+        unsigned i = 0;
+        for (; i + 8 <= size; i += 8) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+        }
+        float unpack[4] __attribute__((aligned(16)));
+        _mm_store_ps(unpack, _mm_add_ps(sum0, sum1));
+        float result = unpack[0] + unpack[1] + unpack[2] + unpack[3];
+        for (; i < size; i++) {
+            float diff = a[i] - b[i];
+            result += diff * diff;
+        }
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline float l2_sqr_avx2(const float *a, const float *b, unsigned size) {
+        __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+        unsigned i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+            __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+            __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+            sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+            sum1 = _mm256_fmadd_ps(d1, d1, sum1);
+            sum2 = _mm256_fmadd_ps(d2, d2, sum2);
+            sum3 = _mm256_fmadd_ps(d3, d3, sum3);
+        }
+        for (; i + 8 <= size; i += 8) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+        }
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_movehdup_ps(half));
+        float result = _mm_cvtss_f32(half);
+        for (; i < size; i++) {
+            float diff = a[i] - b[i];
+            result += diff * diff;
+        }
+        return result;
+    }
+
+    // four independent accumulators hide the latency of the fma chain;
+    // the tail is handled with a masked load instead of a scalar loop
+    __attribute__((target("avx512f")))
+    inline float l2_sqr_avx512(const float *a, const float *b, unsigned size) {
+        __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+        unsigned i = 0;
+        for (; i + 64 <= size; i += 64) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+            __m512 d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+            __m512 d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+            sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+            sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+            sum2 = _mm512_fmadd_ps(d2, d2, sum2);
+            sum3 = _mm512_fmadd_ps(d3, d3, sum3);
+        }
+        for (; i + 16 <= size; i += 16) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+        }
+        if (i < size) {
+            __mmask16 mask = (__mmask16) ((1u << (size - i)) - 1);
+            __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                      _mm512_maskz_loadu_ps(mask, b + i));
+            sum1 = _mm512_fmadd_ps(d0, d0, sum1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(sum0, sum1),
+                                                  _mm512_add_ps(sum2, sum3)));
+    }
+
+    inline float dot_scalar(const float *a, const float *b, unsigned size) {
+        float result = 0;
+        float dot0, dot1, dot2, dot3;
+        const float *last = a + size;
+        const float *unroll_group = last - 3;
+
+        /* Process 4 items with each loop for efficiency. */
+        while (a < unroll_group) {
+            dot0 = a[0] * b[0];
+            dot1 = a[1] * b[1];
+            dot2 = a[2] * b[2];
+            dot3 = a[3] * b[3];
+            result += dot0 + dot1 + dot2 + dot3;
+            a += 4;
+            b += 4;
+        }
+        /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
+        while (a < last) {
+            result += *a++ * *b++;
+        }
+        return result;
+    }
+
+    inline float dot_sse(const float *a, const float *b, unsigned size) {
+        __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+        unsigned i = 0;
+        for (; i + 8 <= size; i += 8) {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        float unpack[4] __attribute__((aligned(16)));
+        _mm_store_ps(unpack, _mm_add_ps(sum0, sum1));
+        float result = unpack[0] + unpack[1] + unpack[2] + unpack[3];
+        for (; i < size; i++)
+            result += a[i] * b[i];
+        return result;
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline float dot_avx2(const float *a, const float *b, unsigned size) {
+        __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+        unsigned i = 0;
+        for (; i + 32 <= size; i += 32) {
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+            sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+            sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), sum2);
+            sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), sum3);
+        }
+        for (; i + 8 <= size; i += 8)
+            sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), _mm256_add_ps(sum2, sum3));
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_movehdup_ps(half));
+        float result = _mm_cvtss_f32(half);
+        for (; i < size; i++)
+            result += a[i] * b[i];
+        return result;
+    }
+
+    __attribute__((target("avx512f")))
+    inline float dot_avx512(const float *a, const float *b, unsigned size) {
+        __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+        unsigned i = 0;
+        for (; i + 64 <= size; i += 64) {
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+            sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), sum1);
+            sum2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), sum2);
+            sum3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), sum3);
+        }
+        for (; i + 16 <= size; i += 16)
+            sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+        if (i < size) {
+            __mmask16 mask = (__mmask16) ((1u << (size - i)) - 1);
+            sum1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                   _mm512_maskz_loadu_ps(mask, b + i), sum1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(sum0, sum1),
+                                                  _mm512_add_ps(sum2, sum3)));
+    }
+
+    typedef float (*float_kernel_t)(const float *, const float *, unsigned);
+
+    static const float_kernel_t l2_sqr =
+            select_kernel<float_kernel_t>(l2_sqr_avx512, l2_sqr_avx2, l2_sqr_sse, l2_sqr_scalar);
+    static const float_kernel_t dot =
+            select_kernel<float_kernel_t>(dot_avx512, dot_avx2, dot_sse, dot_scalar);
+
+    // Squared distance between 1-byte vectors (the points quantized with
+    // -quantize_build).  Both operands are widened to 16 bits before the
+    // multiply, so results are exact, and products are pairwise summed into
+    // 32-bit lanes with madd on AVX2 and with the VNNI dpwssd instruction on
+    // AVX-512.
+    inline bool detect_avx512_vnni() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni");
+    }
+
+    template<typename Kernel>
+    Kernel select_byte_kernel(Kernel vnni, Kernel avx2, Kernel scalar) {
+        if (detect_avx512_vnni()) return vnni;
+        return select_kernel(avx2, avx2, scalar, scalar);
+    }
+
+    inline float l2_sqr_uint8_scalar(const uint8_t *a, const uint8_t *b, unsigned size) {
+        int32_t result = 0;
+        for (unsigned i = 0; i < size; i++) {
+            int32_t diff = (int32_t) a[i] - (int32_t) b[i];
+            result += diff * diff;
+        }
+        return (float) result;
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i widen_uint8_avx2(const uint8_t *p) {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p));
+    }
+
+    __attribute__((target("avx2")))
+    inline float l2_sqr_uint8_avx2(const uint8_t *a, const uint8_t *b, unsigned size) {
+        __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+        unsigned i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i d0 = _mm256_sub_epi16(widen_uint8_avx2(a + i), widen_uint8_avx2(b + i));
+            __m256i d1 = _mm256_sub_epi16(widen_uint8_avx2(a + i + 16), widen_uint8_avx2(b + i + 16));
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(d0, d0));
+            sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(d1, d1));
+        }
+        for (; i + 16 <= size; i += 16) {
+            __m256i d0 = _mm256_sub_epi16(widen_uint8_avx2(a + i), widen_uint8_avx2(b + i));
+            sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(d0, d0));
+        }
+        __m256i sum = _mm256_add_epi32(sum0, sum1);
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+        int32_t result = _mm_cvtsi128_si32(s);
+        for (; i < size; i++) {
+            int32_t diff = (int32_t) a[i] - (int32_t) b[i];
+            result += diff * diff;
+        }
+        return (float) result;
+    }
+
+    __attribute__((target("avx512bw,avx512vnni")))
+    inline __m512i widen_uint8_avx512(const uint8_t *p) {
+        return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *) p));
+    }
+
+    __attribute__((target("avx512bw,avx512vnni")))
+    inline float l2_sqr_uint8_vnni(const uint8_t *a, const uint8_t *b, unsigned size) {
+        __m512i sum0 = _mm512_setzero_si512(), sum1 = _mm512_setzero_si512();
+        unsigned i = 0;
+        for (; i + 64 <= size; i += 64) {
+            __m512i d0 = _mm512_sub_epi16(widen_uint8_avx512(a + i), widen_uint8_avx512(b + i));
+            __m512i d1 = _mm512_sub_epi16(widen_uint8_avx512(a + i + 32), widen_uint8_avx512(b + i + 32));
+            sum0 = _mm512_dpwssd_epi32(sum0, d0, d0);
+            sum1 = _mm512_dpwssd_epi32(sum1, d1, d1);
+        }
+        for (; i + 32 <= size; i += 32) {
+            __m512i d0 = _mm512_sub_epi16(widen_uint8_avx512(a + i), widen_uint8_avx512(b + i));
+            sum0 = _mm512_dpwssd_epi32(sum0, d0, d0);
+        }
+        int32_t result = _mm512_reduce_add_epi32(_mm512_add_epi32(sum0, sum1));
+        for (; i < size; i++) {
+            int32_t diff = (int32_t) a[i] - (int32_t) b[i];
+            result += diff * diff;
+        }
+        return (float) result;
+    }
 
-#ifdef __GNUC__
-#ifdef __AVX__
+    typedef float (*uint8_kernel_t)(const uint8_t *, const uint8_t *, unsigned);
 
-#define AVX_L2SQR(addr1, addr2, dest, tmp1, tmp2) \
-  tmp1 = _mm256_loadu_ps(addr1);                  \
-  tmp2 = _mm256_loadu_ps(addr2);                  \
-  tmp1 = _mm256_sub_ps(tmp1, tmp2);               \
-  tmp1 = _mm256_mul_ps(tmp1, tmp1);               \
-  dest = _mm256_add_ps(dest, tmp1);
+    static const uint8_kernel_t l2_sqr_uint8 =
+            select_byte_kernel<uint8_kernel_t>(l2_sqr_uint8_vnni, l2_sqr_uint8_avx2, l2_sqr_uint8_scalar);
 
-            __m256 sum;
-            __m256 l0, l1;
-            __m256 r0, r1;
-            size_t qty16 = size >> 4;
-            size_t aligned_size = qty16 << 4;
-            const float *l = a;
-            const float *r = b;
+    // The same kernels with the dimension fixed at compile time, so their
+    // loops are fully unrolled and the tail handling is resolved statically.
+    // Used by points whose dimension is a template parameter.
+    template<unsigned D>
+    struct fixed_dim_kernels {
+        static float l2_sqr_scalar_(const float *a, const float *b, unsigned) {
+            return l2_sqr_scalar(a, b, D);
+        }
 
-            float unpack[8] __attribute__((aligned(32))) = {0, 0, 0, 0, 0, 0, 0, 0};
-            sum = _mm256_loadu_ps(unpack);
+        static float l2_sqr_sse_(const float *a, const float *b, unsigned) {
+            return l2_sqr_sse(a, b, D);
+        }
 
-            for (unsigned i = 0; i < aligned_size; i += 16, l += 16, r += 16) {
-              AVX_L2SQR(l, r, sum, l0, r0);
-              AVX_L2SQR(l + 8, r + 8, sum, l1, r1);
-            }
-            _mm256_storeu_ps(unpack, sum);
-            result = unpack[0] + unpack[1] + unpack[2] + unpack[3] + unpack[4] + unpack[5] + unpack[6] + unpack[7];
-            for (unsigned i = aligned_size; i < size; ++i, ++l, ++r) {
-              float diff = *l - *r;
-              result += diff * diff;
-            }
+        __attribute__((target("avx2,fma")))
+        static float l2_sqr_avx2_(const float *a, const float *b, unsigned) {
+            return l2_sqr_avx2(a, b, D);
+        }
 
-            /*
-        #else
-        #ifdef __SSE2__
-        #define SSE_L2SQR(addr1, addr2, dest, tmp1, tmp2) \
-        tmp1 = _mm_load_ps(addr1);\
-        tmp2 = _mm_load_ps(addr2);\
-        tmp1 = _mm_sub_ps(tmp1, tmp2); \
-        tmp1 = _mm_mul_ps(tmp1, tmp1); \
-        dest = _mm_add_ps(dest, tmp1);
-
-        __m128 sum;
-        __m128 l0, l1, l2, l3;
-        __m128 r0, r1, r2, r3;
-        unsigned D = (size + 3) & ~3U;
-        unsigned DR = D % 16;
-        unsigned DD = D - DR;
-        const float *l = a;
-        const float *r = b;
-        const float *e_l = l + DD;
-        const float *e_r = r + DD;
-        float unpack[4] __attribute__ ((aligned (16))) = {0, 0, 0, 0};
-
-        sum = _mm_load_ps(unpack);
-        switch (DR) {
-            case 12:
-            SSE_L2SQR(e_l+8, e_r+8, sum, l2, r2);
-            case 8:
-            SSE_L2SQR(e_l+4, e_r+4, sum, l1, r1);
-            case 4:
-            SSE_L2SQR(e_l, e_r, sum, l0, r0);
-          default:
-            break;
-        }
-        for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-            SSE_L2SQR(l, r, sum, l0, r0);
-            SSE_L2SQR(l + 4, r + 4, sum, l1, r1);
-            SSE_L2SQR(l + 8, r + 8, sum, l2, r2);
-            SSE_L2SQR(l + 12, r + 12, sum, l3, r3);
-        }
-        _mm_storeu_ps(unpack, sum);
-        result += unpack[0] + unpack[1] + unpack[2] + unpack[3];
-        */
-        // normal distance
-#else
+        __attribute__((target("avx512f")))
+        static float l2_sqr_avx512_(const float *a, const float *b, unsigned) {
+            return l2_sqr_avx512(a, b, D);
+        }
 
-            float diff0, diff1, diff2, diff3;
-            const float *last = a + size;
-            const float *unroll_group = last - 3;
+        static float dot_scalar_(const float *a, const float *b, unsigned) {
+            return dot_scalar(a, b, D);
+        }
 
-            /* Process 4 items with each loop for efficiency. */
-            while (a < unroll_group) {
-                diff0 = a[0] - b[0];
-                diff1 = a[1] - b[1];
-                diff2 = a[2] - b[2];
-                diff3 = a[3] - b[3];
-                result += diff0 * diff0 + diff1 * diff1 + diff2 * diff2 + diff3 * diff3;
-                a += 4;
-                b += 4;
-            }
-            /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
-            while (a < last) {
-                diff0 = *a++ - *b++;
-                result += diff0 * diff0;
-            }
-// #endif
-#endif
-#endif
+        static float dot_sse_(const float *a, const float *b, unsigned) {
+            return dot_sse(a, b, D);
+        }
 
-            return result;
+        __attribute__((target("avx2,fma")))
+        static float dot_avx2_(const float *a, const float *b, unsigned) {
+            return dot_avx2(a, b, D);
         }
+
+        __attribute__((target("avx512f")))
+        static float dot_avx512_(const float *a, const float *b, unsigned) {
+            return dot_avx512(a, b, D);
+        }
+
+        static const float_kernel_t l2_sqr;
+        static const float_kernel_t dot;
     };
 
-    class DistanceInnerProduct : public Distance {
-    public:
-        float compare(const float *a, const float *b, unsigned size) const {
-            float result = 0;
-#ifdef __GNUC__
-#ifdef __AVX__
-#define AVX_DOT(addr1, addr2, dest, tmp1, tmp2) \
-  tmp1 = _mm256_loadu_ps(addr1);                \
-  tmp2 = _mm256_loadu_ps(addr2);                \
-  tmp1 = _mm256_mul_ps(tmp1, tmp2);             \
-  dest = _mm256_add_ps(dest, tmp1);
+    template<unsigned D>
+    const float_kernel_t fixed_dim_kernels<D>::l2_sqr =
+            select_kernel<float_kernel_t>(l2_sqr_avx512_, l2_sqr_avx2_, l2_sqr_sse_, l2_sqr_scalar_);
 
-            __m256 sum;
-            __m256 l0, l1;
-            __m256 r0, r1;
-            unsigned D = (size + 7) & ~7U;
-            unsigned DR = D % 16;
-            unsigned DD = D - DR;
-            const float *l = a;
-            const float *r = b;
-            const float *e_l = l + DD;
-            const float *e_r = r + DD;
-            float unpack[8] __attribute__((aligned(32))) = {0, 0, 0, 0, 0, 0, 0, 0};
+    template<unsigned D>
+    const float_kernel_t fixed_dim_kernels<D>::dot =
+            select_kernel<float_kernel_t>(dot_avx512_, dot_avx2_, dot_sse_, dot_scalar_);
 
-            sum = _mm256_loadu_ps(unpack);
-            if (DR) {
-              AVX_DOT(e_l, e_r, sum, l0, r0);
-            }
+    class Distance {
+    public:
+        virtual float compare(const float *a, const float *b,
+                              unsigned length) const = 0;
 
-            for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-              AVX_DOT(l, r, sum, l0, r0);
-              AVX_DOT(l + 8, r + 8, sum, l1, r1);
-            }
-            _mm256_storeu_ps(unpack, sum);
-            result = unpack[0] + unpack[1] + unpack[2] + unpack[3] + unpack[4] +
-                     unpack[5] + unpack[6] + unpack[7];
-        /*
-        #else
-        #ifdef __SSE2__
-              #define SSE_DOT(addr1, addr2, dest, tmp1, tmp2) \
-          tmp1 = _mm128_loadu_ps(addr1);\
-          tmp2 = _mm128_loadu_ps(addr2);\
-          tmp1 = _mm128_mul_ps(tmp1, tmp2); \
-          dest = _mm128_add_ps(dest, tmp1);
-              __m128 sum;
-              __m128 l0, l1, l2, l3;
-              __m128 r0, r1, r2, r3;
-              unsigned D = (size + 3) & ~3U;
-              unsigned DR = D % 16;
-              unsigned DD = D - DR;
-              const float *l = a;
-              const float *r = b;
-              const float *e_l = l + DD;
-              const float *e_r = r + DD;
-              float unpack[4] __attribute__ ((aligned (16))) = {0, 0, 0, 0};
-
-              sum = _mm_load_ps(unpack);
-              switch (DR) {
-                  case 12:
-                  SSE_DOT(e_l+8, e_r+8, sum, l2, r2);
-                  case 8:
-                  SSE_DOT(e_l+4, e_r+4, sum, l1, r1);
-                  case 4:
-                  SSE_DOT(e_l, e_r, sum, l0, r0);
-                default:
-                  break;
-              }
-              for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-                  SSE_DOT(l, r, sum, l0, r0);
-                  SSE_DOT(l + 4, r + 4, sum, l1, r1);
-                  SSE_DOT(l + 8, r + 8, sum, l2, r2);
-                  SSE_DOT(l + 12, r + 12, sum, l3, r3);
-              }
-              _mm_storeu_ps(unpack, sum);
-              result += unpack[0] + unpack[1] + unpack[2] + unpack[3];
-        */
-#else
+        virtual ~Distance() {}
+    };
 
-            float dot0, dot1, dot2, dot3;
-            const float *last = a + size;
-            const float *unroll_group = last - 3;
+    class DistanceL2 : public Distance {
+    public:
+        float compare(const float *a, const float *b, unsigned size) const {
+            return l2_sqr(a, b, size);
+        }
+    };
 
-            /* Process 4 items with each loop for efficiency. */
-            while (a < unroll_group) {
-                dot0 = a[0] * b[0];
-                dot1 = a[1] * b[1];
-                dot2 = a[2] * b[2];
-                dot3 = a[3] * b[3];
-                result += dot0 + dot1 + dot2 + dot3;
-                a += 4;
-                b += 4;
-            }
-            /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
-            while (a < last) {
-                result += *a++ * *b++;
-            }
-// #endif
-#endif
-#endif
-            return result;
+    class DistanceInnerProduct : public Distance {
+    public:
+        float compare(const float *a, const float *b, unsigned size) const {
+            return dot(a, b, size);
         }
     };
 
@@ -36,6 +36,80 @@
 #include "types.h"
 #include "graph.h"
 #include "stats.h"
+#include "neighbor_queue.h"
+#include "visited_table.h"
+#include "navigation_layer.h"
+#include "search_results.h"
+
+// The buffers used by a beam search.  They are sized from the
+// QueryParams of each search but never shrink, so a search that reuses a
+// SearchScratch does not allocate once the buffers have grown to the sizes
+// it needs.  The beam search leaves its results in frontier and visited,
+// the number of neighbors it skipped because they had already been seen
+// in seen_skips, and the number of steps it took in hops; the rerank
+// buffers are used by beam_search_rerank.
+template<typename indexType, typename distanceType>
+struct alignas(64) SearchScratch {
+    using pid = std::pair<indexType, distanceType>;
+
+    VisitedTable<indexType> seen;
+    size_t seen_skips = 0;
+    size_t hops = 0;
+    std::vector<pid> frontier;
+    std::vector<pid> unvisited_frontier;
+    std::vector<pid> expanding;
+    std::vector<pid> visited;
+    std::vector<pid> new_frontier;
+    std::vector<pid> candidates;
+    std::vector<indexType> keep;
+    std::vector<distanceType> keep_dists;
+    std::vector<indexType> rerank_ids;
+    std::vector<pid> rerank_top;
+    std::vector<distanceType> rerank_dists;
+    NeighborPriorityQueue<indexType, distanceType> queue;
+
+    void reset(const QueryParams &QP, size_t n, long max_degree, size_t num_starting_points) {
+        size_t beam = std::max<size_t>(QP.beamSize, num_starting_points);
+        size_t width = std::max<long>(1, QP.beam_width);
+        seen.reset(n, 2 * beam * max_degree);
+        seen_skips = 0;
+        hops = 0;
+        frontier.clear();
+        frontier.reserve(beam);
+        unvisited_frontier.resize(beam);
+        expanding.clear();
+        expanding.reserve(width);
+        visited.clear();
+        visited.reserve(2 * QP.beamSize);
+        new_frontier.resize(beam + width * max_degree);
+        candidates.clear();
+        candidates.reserve(width * max_degree);
+        keep.clear();
+        keep.reserve(width * max_degree);
+        keep_dists.resize(width * max_degree);
+    }
+};
+
+// One SearchScratch for each parlay worker, for the searches of a
+// parallel_for.  A worker must not fork while its scratch holds a search
+// it still needs, since it could pick up another search that reuses it.
+// A pool should live as long as the searches that use it, since the
+// visited table of each worker is allocated on its first search; shared()
+// is one for the whole program.
+template<typename indexType, typename distanceType>
+struct SearchScratchPool {
+    SearchScratchPool() : scratch(parlay::num_workers()) {}
+
+    SearchScratch<indexType, distanceType> &get() { return scratch[parlay::worker_id()]; }
+
+    static SearchScratchPool &shared() {
+        static SearchScratchPool pool;
+        return pool;
+    }
+
+private:
+    std::vector<SearchScratch<indexType, distanceType>> scratch;
+};
 
 // main beam search
 template<typename indexType, typename Point, typename PointRange>
@@ -43,6 +117,12 @@ std::pair<std::pair<parlay::sequence<std::pair<indexType, typename Point::distan
 beam_search_impl(Point p, Graph<indexType> &G, PointRange &Points,
                  parlay::sequence<indexType> starting_points, QueryParams &QP);
 
+// main beam search, leaving its results in scratch
+template<typename indexType, typename Point, typename PointRange>
+size_t beam_search_impl(Point p, Graph<indexType> &G, PointRange &Points,
+                        const parlay::sequence<indexType> &starting_points, QueryParams &QP,
+                        SearchScratch<indexType, typename Point::distanceType> &scratch);
+
 template<typename Point, typename PointRange, typename indexType>
 std::pair<std::pair<parlay::sequence<std::pair<indexType, typename Point::distanceType>>, parlay::sequence<std::pair<indexType, typename Point::distanceType>>>, indexType>
 beam_search(Point p, Graph<indexType> &G, PointRange &Points,
@@ -59,11 +139,40 @@ beam_search(Point p, Graph<indexType> &G, PointRange &Points,
     return beam_search_impl<indexType>(p, G, Points, starting_points, QP);
 }
 
-// main beam search
+template<typename Point, typename PointRange, typename indexType>
+size_t beam_search(Point p, Graph<indexType> &G, PointRange &Points,
+                   const parlay::sequence<indexType> &starting_points, QueryParams &QP,
+                   SearchScratch<indexType, typename Point::distanceType> &scratch) {
+    return beam_search_impl<indexType>(p, G, Points, starting_points, QP, scratch);
+}
+
 template<typename indexType, typename Point, typename PointRange>
 std::pair<std::pair<parlay::sequence<std::pair<indexType, typename Point::distanceType>>, parlay::sequence<std::pair<indexType, typename Point::distanceType>>>, size_t>
 beam_search_impl(Point p, Graph<indexType> &G, PointRange &Points,
                  parlay::sequence<indexType> starting_points, QueryParams &QP) {
+    using pid = std::pair<indexType, typename Point::distanceType>;
+    // the scratch of this worker in the shared pool, so that the visited
+    // table is not reallocated for every search.  The results are copied out
+    // sequentially since a parallel copy could fork and steal another search
+    // on this worker.
+    auto &scratch = SearchScratchPool<indexType, typename Point::distanceType>::shared().get();
+    size_t dist_cmps = beam_search_impl<indexType>(p, G, Points, starting_points, QP, scratch);
+    parlay::sequence<pid> frontier, visited;
+    frontier.reserve(scratch.frontier.size());
+    for (auto c: scratch.frontier) frontier.push_back(c);
+    visited.reserve(scratch.visited.size());
+    for (auto c: scratch.visited) visited.push_back(c);
+    return std::make_pair(std::make_pair(std::move(frontier), std::move(visited)),
+                          dist_cmps);
+}
+
+// main beam search, leaving its results in scratch.  Compiled with
+// QUEUE_FRONTIER, the frontier is kept in a NeighborPriorityQueue instead
+// of being merged with set_union and set_difference on every hop.
+template<typename indexType, typename Point, typename PointRange>
+size_t beam_search_impl(Point p, Graph<indexType> &G, PointRange &Points,
+                        const parlay::sequence<indexType> &starting_points, QueryParams &QP,
+                        SearchScratch<indexType, typename Point::distanceType> &scratch) {
     if (starting_points.size() == 0) {
         std::cout << "beam search expects at least one start point" << std::endl;
         abort();
@@ -77,89 +186,167 @@ beam_search_impl(Point p, Graph<indexType> &G, PointRange &Points,
     };
 
 
-    // used as a hash filter (can give false negative -- i.e. can say
-    // not in table when it is)
-    int bits = std::max<int>(10, std::ceil(std::log2(QP.beamSize * QP.beamSize)) - 2);
-    std::vector<indexType> hash_filter(1 << bits, -1);
-    auto has_been_seen = [&](indexType a) -> bool {
-        int loc = parlay::hash64_2(a) & ((1 << bits) - 1);
-        if (hash_filter[loc] == a) return true;
-        hash_filter[loc] = a;
-        return false;
-    };
+    scratch.reset(QP, G.size(), G.max_degree(), starting_points.size());
 
-    // Frontier maintains the closest points found so far and its size
-    // is always at most beamSize.  Each entry is a (id,distance) pair.
-    // Initialized with starting points and kept sorted by distance.
-    std::vector<std::pair<indexType, distanceType>> frontier;
-    frontier.reserve(QP.beamSize);
-    for (auto q: starting_points)
-        frontier.push_back(std::pair<indexType, distanceType>(q, Points[q].distance(p)));
-    std::sort(frontier.begin(), frontier.end(), less);
+    // the vertices whose distance has been computed, starting with the
+    // starting points
+    VisitedTable<indexType> &seen = scratch.seen;
+    for (auto q: starting_points) seen.test_and_set(q);
 
-    // The subset of the frontier that has not been visited
-    // Use the first of these to pick next vertex to visit.
-    std::vector<std::pair<indexType, distanceType>> unvisited_frontier(QP.beamSize);
-    unvisited_frontier[0] = frontier[0];
+    std::vector<std::pair<indexType, distanceType>> &frontier = scratch.frontier;
 
     // maintains sorted set of visited vertices (id-distance pairs)
-    std::vector<std::pair<indexType, distanceType>> visited;
-    visited.reserve(2 * QP.beamSize);
+    std::vector<std::pair<indexType, distanceType>> &visited = scratch.visited;
 
     // counters
     size_t dist_cmps = starting_points.size();
-    int remain = 1;
     int num_visited = 0;
-    double total;
+
+    // with a patience, the search stops once that many steps in a row have
+    // not changed the k closest points found
+    long unchanged = 0;
+    bool stable = false;
 
     // used as temporaries in the loop
-    std::vector<std::pair<indexType, distanceType>> new_frontier(
-            std::max<size_t>(QP.beamSize, starting_points.size()) + G.max_degree());
-    std::vector<std::pair<indexType, distanceType>> candidates;
-    candidates.reserve(G.max_degree());
-    std::vector<indexType> keep;
-    keep.reserve(G.max_degree());
+    std::vector<std::pair<indexType, distanceType>> &candidates = scratch.candidates;
+    std::vector<indexType> &keep = scratch.keep;
+    std::vector<distanceType> &keep_dists = scratch.keep_dists;
+
+    // the (up to) beam_width closest unvisited vertices, which are expanded
+    // together in each step
+    std::vector<std::pair<indexType, distanceType>> &expanding = scratch.expanding;
+    size_t width = std::max<long>(1, QP.beam_width);
+
+    // the edges of this many of the vertices likely to be expanded next are
+    // prefetched while the current ones are scored, and the vector of each
+    // neighbor is prefetched prefetch_distance neighbors ahead of the one
+    // being scored (or all of them up front, if prefetch_distance is 0)
+    constexpr int adjacency_lookahead = 2;
+    size_t prefetch_distance = std::max<long>(0, QP.prefetch_distance);
+
+#ifdef QUEUE_FRONTIER
+    // The frontier holds at most beamSize of the closest points found so
+    // far, and its cursor is at the closest one not yet visited.  Visited
+    // vertices are appended in the order they are visited and only sorted
+    // at the end.
+    NeighborPriorityQueue<indexType, distanceType> &queue = scratch.queue;
+    queue.reset(QP.beamSize);
+    for (auto q: starting_points)
+        queue.insert(std::pair<indexType, distanceType>(q, Points[q].distance(p)));
+
+    // The main loop.  Terminate beam search when the entire frontier
+    // has been visited or have reached max_visit.
+    while (queue.has_unexpanded() && num_visited < QP.limit && !stable) {
+        expanding.clear();
+        while (queue.has_unexpanded() && expanding.size() < width && num_visited < QP.limit) {
+            expanding.push_back(queue.expand_next());
+            visited.push_back(expanding.back());
+            num_visited++;
+        }
+        for (auto current: expanding) G[current.first].prefetch();
+        queue.peek_unexpanded(adjacency_lookahead, [&](auto c) { G[c.first].prefetch(); });
+#else
+    // Frontier maintains the closest points found so far and its size
+    // is always at most beamSize.  Each entry is a (id,distance) pair.
+    // Initialized with starting points and kept sorted by distance.
+    for (auto q: starting_points)
+        frontier.push_back(std::pair<indexType, distanceType>(q, Points[q].distance(p)));
+    std::sort(frontier.begin(), frontier.end(), less);
+
+    // The subset of the frontier that has not been visited
+    // Use the first of these to pick next vertex to visit.
+    std::vector<std::pair<indexType, distanceType>> &unvisited_frontier = scratch.unvisited_frontier;
+    std::copy(frontier.begin(), frontier.end(), unvisited_frontier.begin());
+    std::vector<std::pair<indexType, distanceType>> &new_frontier = scratch.new_frontier;
+    int remain = frontier.size();
 
     // The main loop.  Terminate beam search when the entire frontier
     // has been visited or have reached max_visit.
-    while (remain > 0 && num_visited < QP.limit) {
-        // the next node to visit is the unvisited frontier node that is closest to
-        // p
-        std::pair<indexType, distanceType> current = unvisited_frontier[0];
-        G[current.first].prefetch();
-        // add to visited set
-        visited.insert(
-                std::upper_bound(visited.begin(), visited.end(), current, less),
-                current);
-        num_visited++;
-
-        // keep neighbors that have not been visited (using approximate
-        // hash). Note that if a visited node is accidentally kept due to
-        // approximate hash it will be removed below by the union or will
-        // not bump anyone else.
+    while (remain > 0 && num_visited < QP.limit && !stable) {
+        // the next nodes to visit are the unvisited frontier nodes that are
+        // closest to p
+        expanding.clear();
+        for (int j = 0; j < remain && expanding.size() < width && num_visited < QP.limit; j++) {
+            std::pair<indexType, distanceType> current = unvisited_frontier[j];
+            expanding.push_back(current);
+            // add to visited set
+            visited.insert(
+                    std::upper_bound(visited.begin(), visited.end(), current, less),
+                    current);
+            num_visited++;
+        }
+        for (auto current: expanding) G[current.first].prefetch();
+        int taken = expanding.size();
+        for (int j = taken; j < remain && j < taken + adjacency_lookahead; j++)
+            G[unvisited_frontier[j].first].prefetch();
+#endif
+
+        scratch.hops++;
+
+        // keep neighbors that have not been seen before, so that the
+        // distances to all of them are computed as one batch
         candidates.clear();
         keep.clear();
-        long num_ele = std::min<long>(G[current.first].size(), QP.degree_limit);
-        for (indexType i = 0; i < num_ele; i++) {
-            auto a = G[current.first][i];
-            if (has_been_seen(a) || Points[a].same_as(p)) continue;  // skip if already seen
-            keep.push_back(a);
-            Points[a].prefetch();
+        for (auto current: expanding) {
+            long num_ele = std::min<long>(G[current.first].size(), QP.degree_limit);
+            for (indexType i = 0; i < num_ele; i++) {
+                auto a = G[current.first][i];
+                if (seen.test_and_set(a)) {  // skip if already seen
+                    scratch.seen_skips++;
+                    continue;
+                }
+                if (Points[a].same_as(p)) continue;
+                keep.push_back(a);
+            }
         }
 
         // Further filter on whether distance is greater than current
         // furthest distance in current frontier (if full).
+#ifdef QUEUE_FRONTIER
+        distanceType cutoff = (!queue.full()
+                               ? (distanceType) std::numeric_limits<int>::max()
+                               : queue.furthest());
+        distanceType kth = ((QP.k <= 0 || queue.size() < QP.k)
+                            ? (distanceType) std::numeric_limits<int>::max()
+                            : queue[QP.k - 1].second);
+#else
         distanceType cutoff = ((frontier.size() < QP.beamSize)
                                ? (distanceType) std::numeric_limits<int>::max()
                                : frontier[frontier.size() - 1].second);
-        for (auto a: keep) {
-            distanceType dist = Points[a].distance(p);
-            dist_cmps++;
+        distanceType kth = ((QP.k <= 0 || frontier.size() < QP.k)
+                            ? (distanceType) std::numeric_limits<int>::max()
+                            : frontier[QP.k - 1].second);
+#endif
+        Points.batch_distance(p, keep.data(), keep.size(), keep_dists.data(), prefetch_distance);
+        dist_cmps += keep.size();
+        for (size_t i = 0; i < keep.size(); i++) {
             // skip if frontier not full and distance too large
-            if (dist >= cutoff) continue;
-            candidates.push_back(std::pair{a, dist});
+            if (keep_dists[i] >= cutoff) continue;
+            candidates.push_back(std::pair{keep[i], keep_dists[i]});
+        }
+
+        if (QP.patience > 0 && QP.k > 0) {
+            bool improved = std::any_of(candidates.begin(), candidates.end(),
+                                        [&](auto c) { return c.second < kth; });
+            unchanged = improved ? 0 : unchanged + 1;
+            stable = unchanged >= QP.patience;
         }
 
+#ifdef QUEUE_FRONTIER
+        for (auto c: candidates) queue.insert(c);
+
+        // if a k is given (i.e. k != 0) then trim off entries that have a
+        // distance greater than cut * current-kth-smallest-distance.
+        // Only used during query and not during build.
+        if (QP.k > 0 && queue.size() > QP.k && Points[0].is_metric())
+            queue.truncate(std::upper_bound(queue.begin(), queue.end(),
+                                            std::pair{0, QP.cut * queue[QP.k].second}, less) -
+                           queue.begin());
+    }
+
+    frontier.assign(queue.begin(), queue.end());
+    std::sort(visited.begin(), visited.end(), less);
+#else
         // sort the candidates by distance from p
         std::sort(candidates.begin(), candidates.end(), less);
 
@@ -187,128 +374,279 @@ beam_search_impl(Point p, Graph<indexType> &G, PointRange &Points,
         for (indexType i = 0; i < new_frontier_size; i++)
             frontier.push_back(new_frontier[i]);
 
-        // get the unvisited frontier (we only care about the first one)
+        // get the unvisited frontier (we only care about the first beam_width)
         remain =
                 std::set_difference(frontier.begin(), frontier.end(),
                                     visited.begin(), visited.end(),
                                     unvisited_frontier.begin(), less) -
                 unvisited_frontier.begin();
     }
+#endif
 
-    return std::make_pair(std::make_pair(parlay::to_sequence(frontier),
-                                         parlay::to_sequence(visited)),
-                          dist_cmps);
+    return dist_cmps;
 }
 
 
 template<typename Point, typename PointRange, typename indexType>
-parlay::sequence<parlay::sequence<indexType>> searchAll(PointRange &Query_Points,
+SearchResults<indexType, typename Point::distanceType> searchAll(PointRange &Query_Points,
                                                         Graph<indexType> &G, PointRange &Base_Points,
                                                         stats<indexType> &QueryStats,
-                                                        indexType starting_point, QueryParams &QP) {
+                                                        indexType starting_point, QueryParams &QP,
+                                                        SearchScratchPool<indexType, typename Point::distanceType> &scratch_pool) {
     parlay::sequence<indexType> start_points = {starting_point};
-    return searchAll<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats, start_points, QP);
+    return searchAll<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats, start_points, QP, scratch_pool);
 }
 
 template<typename Point, typename PointRange, typename indexType>
-parlay::sequence<parlay::sequence<indexType>> searchAll(PointRange &Query_Points,
+SearchResults<indexType, typename Point::distanceType> searchAll(PointRange &Query_Points,
                                                         Graph<indexType> &G, PointRange &Base_Points,
                                                         stats<indexType> &QueryStats,
                                                         parlay::sequence<indexType> starting_points,
-                                                        QueryParams &QP) {
+                                                        QueryParams &QP,
+                                                        SearchScratchPool<indexType, typename Point::distanceType> &scratch_pool) {
     if (QP.k > QP.beamSize) {
         std::cout << "Error: beam search parameter Q = " << QP.beamSize
                   << " same size or smaller than k = " << QP.k << std::endl;
         abort();
     }
-    parlay::sequence<parlay::sequence<indexType>> all_neighbors(Query_Points.size());
+    SearchResults<indexType, typename Point::distanceType> results(Query_Points.size(), QP.k);
     parlay::parallel_for(0, Query_Points.size(), [&](size_t i) {
-        parlay::sequence<indexType> neighbors = parlay::sequence<indexType>(QP.k);
-        auto [pairElts, dist_cmps] = beam_search(Query_Points[i], G, Base_Points, starting_points, QP);
-        auto [beamElts, visitedElts] = pairElts;
-        for (indexType j = 0; j < QP.k; j++) {
-            neighbors[j] = beamElts[j].first;
-        }
-        all_neighbors[i] = neighbors;
-        QueryStats.increment_visited(i, visitedElts.size());
+        auto &scratch = scratch_pool.get();
+        size_t dist_cmps = beam_search(Query_Points[i], G, Base_Points, starting_points, QP, scratch);
+        results.set(i, scratch.frontier.begin(), scratch.frontier.end());
+        results.visited[i] = scratch.visited.size();
+        results.dist_cmps[i] = dist_cmps;
+        results.hops[i] = scratch.hops;
+        QueryStats.increment_visited(i, scratch.visited.size());
         QueryStats.increment_dist(i, dist_cmps);
+        QueryStats.increment_seen_skips(i, scratch.seen_skips);
     });
 
-    return all_neighbors;
+    return results;
 }
 
+// leaves its results in the row of results for p
 template<typename Point, typename QPoint, typename PointRange, typename QPointRange, typename indexType>
-parlay::sequence<indexType>
-beam_search_rerank(const Point &p,
+void beam_search_rerank(const Point &p,
                    const QPoint &pq,
                    Graph<indexType> &G,
                    PointRange &Base_Points,
                    QPointRange &Q_Base_Points,
                    stats<indexType> &QueryStats,
-                   parlay::sequence<indexType> starting_points,
-                   QueryParams &QP) {
+                   const parlay::sequence<indexType> &starting_points,
+                   QueryParams &QP,
+                   SearchScratch<indexType, typename QPoint::distanceType> &scratch,
+                   SearchResults<indexType, typename Point::distanceType> &results) {
     // beam search with quantized points
-    auto [pairElts, dist_cmps] = beam_search(pq, G, Q_Base_Points, starting_points, QP);
-    auto [beamElts, visitedElts] = pairElts;
-
-    int exp_factor = 5;
-
-    // recalculate distances with non-quantized points and sort
-    std::vector<std::pair<indexType, typename Point::distanceType>> pts;
-    for (auto [j, ignore]: parlay::tabulate(std::min<int>(QP.k * exp_factor, beamElts.size()),
-                                            [&](long i) { return beamElts[i]; }))
-        pts.push_back(std::pair(j, p.distance(Base_Points[j])));
-    std::sort(pts.begin(), pts.end(), [](auto a, auto b) { return a.second < b.second; });
-
-    // strip off the distances and keep first k
-    parlay::sequence<indexType> neighbors;
-    for (indexType j = 0; j < QP.k; j++)
-        neighbors.push_back(pts[j].first);
-    QueryStats.increment_visited(p.id(), visitedElts.size());
-    QueryStats.increment_dist(p.id(), dist_cmps + beamElts.size());
-    return neighbors;
+    size_t dist_cmps = beam_search(pq, G, Q_Base_Points, starting_points, QP, scratch);
+    auto &beamElts = scratch.frontier;
+
+    // Recalculate distances with non-quantized points for the closest
+    // candidates, keeping the best k in a max-heap.  Candidates are scored a
+    // batch at a time with batch_distance, which prefetches the full vectors
+    // ahead of the one being scored.  With a patience, stop once that many
+    // candidates in a row fail to enter the top k.
+    using distanceType = typename QPoint::distanceType;
+    long depth = std::min<long>(QP.k * QP.rerank_factor, beamElts.size());
+    long batch = std::max<long>(QP.k, 1);
+    auto less = [](const auto &a, const auto &b) { return a.second < b.second; };
+    auto &ids = scratch.rerank_ids;
+    ids.resize(depth);
+    for (long i = 0; i < depth; i++) ids[i] = beamElts[i].first;
+    auto &top = scratch.rerank_top;
+    auto &dists = scratch.rerank_dists;
+    top.clear();
+    dists.resize(batch);
+    long reranked = 0;
+    long unchanged = 0;
+    bool stable = false;
+    while (reranked < depth && !stable) {
+        long start = reranked;
+        long end = std::min(start + batch, depth);
+        Base_Points.batch_distance(p, ids.data() + start, end - start, dists.data());
+        reranked = end;
+        for (long i = start; i < end && !stable; i++) {
+            std::pair<indexType, distanceType> c(ids[i], dists[i - start]);
+            if ((long) top.size() < QP.k) {
+                top.push_back(c);
+                std::push_heap(top.begin(), top.end(), less);
+                unchanged = 0;
+            } else if (c.second < top.front().second) {
+                std::pop_heap(top.begin(), top.end(), less);
+                top.back() = c;
+                std::push_heap(top.begin(), top.end(), less);
+                unchanged = 0;
+            } else unchanged++;
+            stable = QP.rerank_patience > 0 && unchanged >= QP.rerank_patience;
+        }
+    }
+    std::sort_heap(top.begin(), top.end(), less);
+
+    results.set(p.id(), top.begin(), top.end());
+    results.visited[p.id()] = scratch.visited.size();
+    results.dist_cmps[p.id()] = dist_cmps + reranked;
+    results.hops[p.id()] = scratch.hops;
+    QueryStats.increment_visited(p.id(), scratch.visited.size());
+    QueryStats.increment_dist(p.id(), dist_cmps + reranked);
+    QueryStats.increment_seen_skips(p.id(), scratch.seen_skips);
 }
 
 
 template<typename Point, typename PointRange, typename QPointRange, typename indexType>
-parlay::sequence<parlay::sequence<indexType>> qsearchAll(PointRange &Query_Points,
+SearchResults<indexType, typename Point::distanceType> qsearchAll(PointRange &Query_Points,
                                                          QPointRange &Q_Query_Points,
                                                          Graph<indexType> &G,
                                                          PointRange &Base_Points,
                                                          QPointRange &Q_Base_Points,
                                                          stats<indexType> &QueryStats,
-                                                         indexType starting_point, QueryParams &QP) {
+                                                         indexType starting_point, QueryParams &QP,
+                                                         SearchScratchPool<indexType, typename QPointRange::Point::distanceType> &scratch_pool) {
     parlay::sequence<indexType> start_points = {starting_point};
     return qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points,
-                                                                 Q_Base_Points, QueryStats, start_points, QP);
+                                                                 Q_Base_Points, QueryStats, start_points, QP, scratch_pool);
 }
 
 template<typename Point, typename PointRange, typename QPointRange, typename indexType>
-parlay::sequence<parlay::sequence<indexType>> qsearchAll(PointRange &Query_Points,
+SearchResults<indexType, typename Point::distanceType> qsearchAll(PointRange &Query_Points,
                                                          QPointRange &Q_Query_Points,
                                                          Graph<indexType> &G,
                                                          PointRange &Base_Points,
                                                          QPointRange &Q_Base_Points,
                                                          stats<indexType> &QueryStats,
                                                          parlay::sequence<indexType> starting_points,
-                                                         QueryParams &QP) {
+                                                         QueryParams &QP,
+                                                         SearchScratchPool<indexType, typename QPointRange::Point::distanceType> &scratch_pool) {
     if (QP.k > QP.beamSize) {
         std::cout << "Error: beam search parameter Q = " << QP.beamSize
                   << " same size or smaller than k = " << QP.k << std::endl;
         abort();
     }
-    parlay::sequence<parlay::sequence<indexType>> all_neighbors(Query_Points.size());
+    SearchResults<indexType, typename Point::distanceType> results(Query_Points.size(), QP.k);
     parlay::parallel_for(0, Query_Points.size(), [&](size_t i) {
-        all_neighbors[i] = beam_search_rerank(Query_Points[i], Q_Query_Points[i], G,
-                                              Base_Points, Q_Base_Points,
-                                              QueryStats, starting_points, QP);
+        beam_search_rerank(Query_Points[i], Q_Query_Points[i], G,
+                           Base_Points, Q_Base_Points,
+                           QueryStats, starting_points, QP,
+                           scratch_pool.get(), results);
     });
 
-//    for (uint32_t i = 0; i < Query_Points.size(); i++) {
-//        all_neighbors[i] = beam_search_rerank(Query_Points[i], Q_Query_Points[i], G,
-//                                              Base_Points, Q_Base_Points,
-//                                              QueryStats, starting_points, QP);
-//    }
+    return results;
+}
+
+// As above, but each search starts from the QP.route_entries entry points
+// of nav that are closest to its query.  Scanning the table of entry
+// points is counted as that many distance comparisons.
+template<typename Point, typename PointRange, typename QPointRange, typename indexType>
+SearchResults<indexType, typename Point::distanceType> qsearchAll(PointRange &Query_Points,
+                                                         QPointRange &Q_Query_Points,
+                                                         Graph<indexType> &G,
+                                                         PointRange &Base_Points,
+                                                         QPointRange &Q_Base_Points,
+                                                         stats<indexType> &QueryStats,
+                                                         const NavigationLayer<indexType> &nav,
+                                                         QueryParams &QP,
+                                                         SearchScratchPool<indexType, typename QPointRange::Point::distanceType> &scratch_pool) {
+    if (QP.k > QP.beamSize) {
+        std::cout << "Error: beam search parameter Q = " << QP.beamSize
+                  << " same size or smaller than k = " << QP.k << std::endl;
+        abort();
+    }
+    SearchResults<indexType, typename Point::distanceType> results(Query_Points.size(), QP.k);
+    parlay::parallel_for(0, Query_Points.size(), [&](size_t i) {
+        parlay::sequence<indexType> starting_points = nav.route(Query_Points[i], QP.route_entries);
+        beam_search_rerank(Query_Points[i], Q_Query_Points[i], G,
+                           Base_Points, Q_Base_Points,
+                           QueryStats, starting_points, QP,
+                           scratch_pool.get(), results);
+        results.dist_cmps[i] += nav.size();
+        QueryStats.increment_dist(i, nav.size());
+    });
+
+    return results;
+}
+
+// A range search in two phases.  The first is a beam search with a beam
+// of RP.initial_beam.  If the beam is not full of points within the
+// radius, the ones in it are all the search can find.  Otherwise there
+// are likely more, and the second phase looks for them, with
+// RP.beam_doubling by searching again with twice the beam until the beam
+// is no longer full of them, and otherwise by a BFS from them over the
+// points within the radius.  Leaves the points found in result, closest
+// first, and returns the number of distance comparisons and of vertices
+// visited.
+template<typename Point, typename PointRange, typename indexType>
+std::pair<size_t, size_t>
+beam_range_search(Point p, Graph<indexType> &G, PointRange &Points,
+                  const parlay::sequence<indexType> &starting_points, RangeParams &RP,
+                  SearchScratch<indexType, typename Point::distanceType> &scratch,
+                  std::vector<std::pair<indexType, typename Point::distanceType>> &result) {
+    using distanceType = typename Point::distanceType;
+    long beam = std::max<long>(1, RP.initial_beam);
+    QueryParams QP((long) 0, beam, 0.0, (long) G.size(), (long) G.max_degree());
+    auto saturated = [&] {
+        return (long) scratch.frontier.size() == beam && scratch.frontier.back().second <= RP.rad;
+    };
+    size_t dist_cmps = beam_search(p, G, Points, starting_points, QP, scratch);
+    size_t visited = scratch.visited.size();
+    while (RP.beam_doubling && saturated() && beam < (long) G.size()) {
+        beam = std::min<long>(2 * beam, G.size());
+        QP.beamSize = beam;
+        dist_cmps += beam_search(p, G, Points, starting_points, QP, scratch);
+        visited += scratch.visited.size();
+    }
+
+    result.clear();
+    for (auto c: scratch.frontier)
+        if (c.second <= RP.rad) result.push_back(c);
+    if (RP.beam_doubling || !saturated()) return std::pair(dist_cmps, visited);
+
+    // The BFS starts from the points within the radius in the beam or
+    // visited by the beam search, since visited points can have left the
+    // beam, and only expands points within the radius.
+    VisitedTable<indexType> &seen = scratch.seen;
+    seen.reset(G.size(), 2 * result.size() * G.max_degree());
+    for (auto c: result) seen.test_and_set(c.first);
+    for (auto c: scratch.visited)
+        if (c.second <= RP.rad && !seen.test_and_set(c.first)) result.push_back(c);
+    std::vector<indexType> &keep = scratch.keep;
+    for (size_t position = 0; position < result.size(); position++) {
+        indexType next = result[position].first;
+        keep.clear();
+        for (size_t i = 0; i < G[next].size(); i++) {
+            auto a = G[next][i];
+            if (seen.test_and_set(a) || Points[a].same_as(p)) continue;
+            keep.push_back(a);
+            Points[a].prefetch();
+        }
+        visited++;
+        for (auto a: keep) {
+            distanceType d = Points[a].distance(p);
+            dist_cmps++;
+            if (d <= RP.rad) result.push_back(std::pair(a, d));
+        }
+    }
+    std::sort(result.begin(), result.end(), [](auto a, auto b) { return a.second < b.second; });
+    return std::pair(dist_cmps, visited);
+}
+
+template<typename Point, typename PointRange, typename indexType>
+parlay::sequence<parlay::sequence<indexType>> RangeSearch(PointRange &Query_Points,
+                                                          Graph<indexType> &G, PointRange &Base_Points,
+                                                          stats<indexType> &QueryStats,
+                                                          parlay::sequence<indexType> starting_points,
+                                                          RangeParams &RP,
+                                                          SearchScratchPool<indexType, typename Point::distanceType> &scratch_pool) {
+    using pid = std::pair<indexType, typename Point::distanceType>;
+    parlay::sequence<parlay::sequence<indexType>> all_neighbors(Query_Points.size());
+    parlay::parallel_for(0, Query_Points.size(), [&](size_t i) {
+        std::vector<pid> in_range;
+        auto [dist_cmps, visited] = beam_range_search(Query_Points[i], G, Base_Points, starting_points,
+                                                      RP, scratch_pool.get(), in_range);
+        parlay::sequence<indexType> neighbors(in_range.size());
+        for (size_t j = 0; j < in_range.size(); j++) neighbors[j] = in_range[j].first;
+        all_neighbors[i] = std::move(neighbors);
+        QueryStats.increment_visited(i, visited);
+        QueryStats.increment_dist(i, dist_cmps);
+    });
 
     return all_neighbors;
 }
@@ -39,7 +39,8 @@ nn_result checkRecall(
         QPointRange &Q_Base_Points,
         QPointRange &Q_Query_Points,
         groundTruth<indexType> GT,
-        long start_point,
+        const parlay::sequence<indexType> &starting_points,
+        const NavigationLayer<indexType> &nav,
         long k,
         QueryParams &QP,
         bool verbose) {
@@ -49,7 +50,7 @@ nn_result checkRecall(
         abort();
     }
 
-    parlay::sequence<parlay::sequence<indexType>> all_ngh;
+    SearchResults<indexType, typename Point::distanceType> results;
 
     parlay::internal::timer t;
     float query_time;
@@ -57,44 +58,45 @@ nn_result checkRecall(
     QueryStats.clear();
     // to help clear the cache between runs
     auto volatile xx = parlay::random_permutation<long>(5000000);
+    // the pool is shared by all the calls, so the visited tables are only
+    // allocated by the first one
+    auto &scratch_pool = SearchScratchPool<indexType, typename QPointRange::Point::distanceType>::shared();
     t.next_time();
-    all_ngh = qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points,
-                                                                    Q_Base_Points, QueryStats, start_point, QP);
+    if (nav.size() > 0)
+        results = qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points,
+                                                                        Q_Base_Points, QueryStats, nav, QP,
+                                                                        scratch_pool);
+    else
+        results = qsearchAll<Point, PointRange, QPointRange, indexType>(Query_Points, Q_Query_Points, G, Base_Points,
+                                                                        Q_Base_Points, QueryStats, starting_points, QP,
+                                                                        scratch_pool);
     query_time = t.next_time();
 
     size_t n = Query_Points.size();
 
-    // compute recall
+    // compute recall.  The searches return the distances of their
+    // results, so a result is correct if it is no further than the k-th
+    // nearest neighbor, which also counts the points tied with it.
     int numCorrect = 0;
     for (indexType i = 0; i < n; i++) {
-        parlay::sequence<int> results_with_ties;
-        for (indexType l = 0; l < k; l++)
-            results_with_ties.push_back(GT.coordinates(i, l));
         Point qp = Query_Points[i];
         float last_dist = qp.distance(Base_Points[GT.coordinates(i, k - 1)]);
         //float last_dist = GT.distances(i, k-1);
-        for (indexType l = k; l < GT.dimension(); l++) {
-            //if (GT.distances(i,l) == last_dist) {
-            if (qp.distance(Base_Points[GT.coordinates(i, l)]) == last_dist) {
-                results_with_ties.push_back(GT.coordinates(i, l));
-            }
-        }
-        std::set<int> reported_neighbor_s;
-        for (indexType l = 0; l < k; l++) reported_neighbor_s.insert((all_ngh[i])[l]);
-        for (indexType l = 0; l < results_with_ties.size(); l++) {
-            if (reported_neighbor_s.find(results_with_ties[l]) != reported_neighbor_s.end()) {
-                numCorrect += 1;
-            }
-        }
+        for (indexType l = 0; l < k; l++)
+            if (results.neighbor_distances(i)[l] <= last_dist) numCorrect += 1;
     }
     const float recall = static_cast<float>(numCorrect) / static_cast<float>(k * n);
     float QPS = Query_Points.size() / query_time;
+    double hops = (double) parlay::reduce(results.hops) / std::max<size_t>(Query_Points.size(), 1);
     if (verbose)
         std::cout << "search: Q=" << QP.beamSize << ", k=" << QP.k
                   << ", limit=" << QP.limit << ", dlimit=" << QP.degree_limit
+                  << ", width=" << QP.beam_width
                   << ", recall=" << recall
                   << ", visited=" << QueryStats.visited_stats()[0]
+                  << ", hops=" << hops
                   << ", comparisons=" << QueryStats.dist_stats()[0]
+                  << ", seen_skips=" << QueryStats.seen_skip_rate()
                   << ", QPS=" << QPS << std::endl;
 
     auto stats_ = {QueryStats.dist_stats(), QueryStats.visited_stats()};
@@ -155,15 +157,32 @@ void search_and_parse(Graph_ G_,
                       QPointRange &Q_Query_Points,
                       groundTruth<indexType> GT, char *res_file, long k,
                       indexType start_point = 0,
-                      bool verbose = false) {
+                      bool verbose = false, long rerank_factor = 5,
+                      long rerank_patience = 0, long beam_width = 1,
+                      long prefetch_distance = 4, long patience = 0,
+                      long route_entries = 0) {
     parlay::sequence<nn_result> results;
     std::vector<long> beams;
     std::vector<long> allr;
     std::vector<double> cuts;
 
+    // searches start from the entry points saved with the graph, if any
+    parlay::sequence<indexType> starting_points = G.entry_points();
+    if (starting_points.size() == 0) starting_points = {start_point};
+    // and with route_entries, from the ones closest to each query
+    NavigationLayer<indexType> nav;
+    if (route_entries > 0 && (long) starting_points.size() > route_entries)
+        nav = NavigationLayer<indexType>(Base_Points, starting_points);
+
     QueryParams QP;
     QP.limit = (long) G.size();
     QP.degree_limit = (long) G.max_degree();
+    QP.rerank_factor = rerank_factor;
+    QP.rerank_patience = rerank_patience;
+    QP.beam_width = beam_width;
+    QP.prefetch_distance = prefetch_distance;
+    QP.patience = patience;
+    QP.route_entries = route_entries;
     beams = {10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 22, 24, 26, 28, 30, 32,
              34, 36, 38, 40, 45, 50, 55, 60, 65, 70, 80, 90, 100, 120, 140, 160,
              180, 200, 225, 250, 275, 300, 375, 500, 750, 1000};
@@ -182,7 +201,7 @@ void search_and_parse(Graph_ G_,
                     results.push_back(
                             checkRecall<Point, PointRange, QPointRange, indexType>(G, Base_Points, Query_Points,
                                                                                    Q_Base_Points, Q_Query_Points, GT,
-                                                                                   start_point, r, QP,
+                                                                                   starting_points, nav, r, QP,
                                                                                    verbose));
                 }
             }
@@ -194,6 +213,12 @@ void search_and_parse(Graph_ G_,
         parlay::sequence<long> degree_limits = calculate_limits(G.max_degree());
         degree_limits.push_back(G.max_degree());
         QP = QueryParams(r, r, 1.35, (long) G.size(), (long) G.max_degree());
+        QP.rerank_factor = rerank_factor;
+        QP.rerank_patience = rerank_patience;
+        QP.beam_width = beam_width;
+        QP.prefetch_distance = prefetch_distance;
+        QP.patience = patience;
+        QP.route_entries = route_entries;
         for (long l: limits) {
             QP.limit = l;
             QP.beamSize = std::max<long>(l, r);
@@ -202,15 +227,21 @@ void search_and_parse(Graph_ G_,
                 results.push_back(checkRecall<Point, PointRange, QPointRange, indexType>(G,
                                                                                          Base_Points, Query_Points,
                                                                                          Q_Base_Points, Q_Query_Points,
-                                                                                         GT, start_point, r, QP,
+                                                                                         GT, starting_points, nav, r, QP,
                                                                                          verbose));
             }
         }
         // check "best accuracy"
         QP = QueryParams((long) 100, (long) 1000, (double) 10.0, (long) G.size(), (long) G.max_degree());
+        QP.rerank_factor = rerank_factor;
+        QP.rerank_patience = rerank_patience;
+        QP.beam_width = beam_width;
+        QP.prefetch_distance = prefetch_distance;
+        QP.patience = patience;
+        QP.route_entries = route_entries;
         results.push_back(
                 checkRecall<Point, PointRange, QPointRange, indexType>(G, Base_Points, Query_Points, Q_Base_Points,
-                                                                       Q_Query_Points, GT, start_point, r, QP,
+                                                                       Q_Query_Points, GT, starting_points, nav, r, QP,
                                                                        verbose));
 
         parlay::sequence<float> buckets = {.1, .2, .3, .4, .5, .6, .7, .75, .8, .85,
@@ -0,0 +1,90 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+
+#include "beamSearch.h"
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "types.h"
+#include "stats.h"
+
+// Runs a range search of all the queries and reports its recall and QPS.
+// Every point a range search returns is within the radius, so its recall
+// is just the number of points it returns over the number there are, on
+// average over the queries with any (pointwise) and over all of them
+// (cumulative).
+template<typename Point, typename PointRange, typename indexType>
+void checkRangeRecall(Graph<indexType> &G,
+                      PointRange &Base_Points,
+                      PointRange &Query_Points,
+                      RangeGroundTruth<indexType> &GT,
+                      RangeParams RP,
+                      parlay::sequence<indexType> &start_points) {
+    auto &scratch_pool = SearchScratchPool<indexType, typename Point::distanceType>::shared();
+    parlay::internal::timer t;
+    stats<indexType> QueryStats(Query_Points.size());
+    auto all_rr = RangeSearch<Point, PointRange, indexType>(Query_Points, G, Base_Points, QueryStats,
+                                                            start_points, RP, scratch_pool);
+    double query_time = t.next_time();
+
+    double pointwise_recall = 0.0;
+    double reported_results = 0.0;
+    double total_results = 0.0;
+    long num_nonzero = 0;
+    for (size_t i = 0; i < Query_Points.size(); i++) {
+        double num_reported_results = all_rr[i].size();
+        double num_actual_results = GT[i].size();
+        reported_results += num_reported_results;
+        total_results += num_actual_results;
+        if (num_actual_results != 0) {
+            pointwise_recall += num_reported_results / num_actual_results;
+            num_nonzero++;
+        }
+    }
+    pointwise_recall /= std::max<long>(num_nonzero, 1);
+    double cumulative_recall = reported_results / std::max(total_results, 1.0);
+    double QPS = Query_Points.size() / query_time;
+
+    std::cout << "For ";
+    RP.print();
+    std::cout << ", Pointwise Recall = " << pointwise_recall << ", Cumulative Recall = " << cumulative_recall
+              << ", visited = " << QueryStats.visited_stats()[0]
+              << ", comparisons = " << QueryStats.dist_stats()[0]
+              << ", QPS = " << QPS << std::endl;
+}
+
+template<typename Point, typename PointRange, typename indexType>
+void range_search_wrapper(Graph<indexType> &G, PointRange &Base_Points,
+                          PointRange &Query_Points,
+                          RangeGroundTruth<indexType> &GT, double rad,
+                          parlay::sequence<indexType> &start_points, bool beam_doubling = false) {
+    std::vector<long> beams = {10, 20, 30, 40, 50, 100, 1000, 2000, 3000};
+    for (long b: beams) {
+        RangeParams RP(rad, b);
+        RP.beam_doubling = beam_doubling;
+        checkRangeRecall<Point, PointRange, indexType>(G, Base_Points, Query_Points, GT, RP, start_points);
+    }
+}
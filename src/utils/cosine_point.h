@@ -0,0 +1,118 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "parlay/parallel.h"
+#include "parlay/primitives.h"
+#include "NSGDist.h"
+#include "mips_point.h"
+
+// Cosine distance (negated cosine similarity).  The vectors are left as
+// they are; instead the PointRange caches the inverse norm of each vector
+// when it is loaded (see cached_norm), and the distance scales their inner
+// product by the two inverse norms.
+template<typename T, unsigned fixed_dims = 0>
+struct Cosine_Point {
+    using distanceType = float;
+
+    struct parameters {
+        int dims;
+        const float *norms;  // inverse norms of the points of the range
+
+        parameters() : dims(0), norms(nullptr) {}
+
+        parameters(int dims) : dims(dims), norms(nullptr) {}
+    };
+
+    static distanceType d_min() { return -std::numeric_limits<float>::max(); }
+
+    static bool is_metric() { return false; }
+
+    T operator[](long i) const { return *(values + i); }
+
+    float distance(const Cosine_Point &x) const {
+        return mips_distance<fixed_dims>(this->values, x.values, params.dims)
+               * inverse_norm() * x.inverse_norm();
+    }
+
+    // points built outside of a range (e.g. with id -1) have no cached norm
+    float inverse_norm() const {
+        if (params.norms != nullptr && id_ >= 0) return params.norms[id_];
+        return cached_norm(values, params.dims);
+    }
+
+    static float cached_norm(const T *values, int dims) {
+        float norm = std::sqrt(-mips_distance(values, values, dims));
+        return norm == 0 ? 1.0f : 1.0f / norm;
+    }
+
+    void prefetch() const {
+        int l = (params.dims * sizeof(T) - 1) / 64 + 1;
+        for (int i = 0; i < l; i++)
+            __builtin_prefetch((char *) values + i * 64);
+        if (params.norms != nullptr) __builtin_prefetch(params.norms + id_);
+    }
+
+    long id() const { return id_; }
+
+    Cosine_Point() : values(nullptr), id_(-1), params(0) {}
+
+    Cosine_Point(T *values, long id, parameters params)
+            : values(values), id_(id), params(params) {}
+
+    bool operator==(const Cosine_Point &q) const {
+        for (int i = 0; i < params.dims; i++) {
+            if (values[i] != q.values[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool same_as(const Cosine_Point &q) const {
+        return values == q.values;
+    }
+
+    // cosine distance does not depend on the norms, so there is nothing to do
+    void normalize() {}
+
+    template<typename Point>
+    static void translate_point(T *values, const Point &p, const parameters &params) {
+        for (int j = 0; j < params.dims; j++) values[j] = (T) p[j];
+    }
+
+    template<typename PR>
+    static parameters generate_parameters(const PR &pr) {
+        return parameters(pr.dimension());
+    }
+
+private:
+    T *values;
+    long id_;
+    parameters params;
+};
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <algorithm>
+#include <fstream>
 #include <iostream>
 
 #include "parlay/parallel.h"
@@ -46,8 +47,37 @@ float euclidian_distance(const float *p, const float *q, unsigned d) {
     return distfunc.compare(p, q, d);
 }
 
+float euclidian_distance(const uint8_t *p, const uint8_t *q, unsigned d) {
+    return efanna2e::l2_sqr_uint8(p, q, d);
+}
+
+float euclidian_distance(const uint16_t *p, const uint16_t *q, unsigned d) {
+    int64_t result = 0;
+    for (int i = 0; i < d; i++) {
+        int32_t qi = (int32_t) p[i];
+        int32_t pi = (int32_t) q[i];
+        result += (qi - pi) * (qi - pi);
+    }
+    return (float) (result >> 8);
+}
+
+// distance for points whose dimension D is known at compile time (D = 0
+// means it is only known at runtime and d is used instead)
+template<unsigned D, typename T>
+float euclidian_distance(const T *p, const T *q, unsigned d) {
+    return euclidian_distance(p, q, d);
+}
+
+template<unsigned D>
+float euclidian_distance(const float *p, const float *q, unsigned d) {
+    if (D == 0) return euclidian_distance(p, q, d);
+    return efanna2e::fixed_dim_kernels<D>::l2_sqr(p, q, D);
+}
+
 // this looks like the union of the array
-template<typename T, long range = (1l << sizeof(T) * 8) - 1>
+// fixed_dims, if non-zero, is the dimension of every point, which lets the
+// distance kernel be specialized for it (see Fixed_Euclidian_Point)
+template<typename T, long range = (1l << sizeof(T) * 8) - 1, unsigned fixed_dims = 0>
 struct Euclidian_Point {
     using distanceType = float;
 
@@ -64,6 +94,28 @@ struct Euclidian_Point {
                 : slope(range / (max_val - min_val)),
                   offset((int32_t) round(min_val * slope)),
                   dims(dims) {}
+
+        // saved next to a graph built on quantized points, so that searching
+        // the graph quantizes the same way
+        void save(const char *filename) const {
+            std::cout << "Writing quantization parameters to " << filename << std::endl;
+            std::ofstream writer(filename, std::ios::binary | std::ios::out);
+            writer.write((char *) &slope, sizeof(float));
+            writer.write((char *) &offset, sizeof(int32_t));
+            writer.write((char *) &dims, sizeof(int));
+            writer.close();
+        }
+
+        static parameters read(const char *filename) {
+            std::ifstream reader(filename, std::ios::binary);
+            assert(reader.is_open());
+            parameters p;
+            reader.read((char *) &p.slope, sizeof(float));
+            reader.read((char *) &p.offset, sizeof(int32_t));
+            reader.read((char *) &p.dims, sizeof(int));
+            std::cout << "Read quantization parameters from " << filename << std::endl;
+            return p;
+        }
     };
 
     static distanceType d_min() { return 0; }
@@ -73,7 +125,7 @@ struct Euclidian_Point {
     T operator[](long i) const { return *(values + i); }
 
     float distance(const Euclidian_Point &x) const {
-        return euclidian_distance(this->values, x.values, params.dims);
+        return euclidian_distance<fixed_dims>(this->values, x.values, params.dims);
     }
 
     void normalize() {
@@ -165,3 +217,6 @@ private:
     T *values;
     long id_;
 };
+
+template<typename T, unsigned fixed_dims>
+using Fixed_Euclidian_Point = Euclidian_Point<T, (1l << sizeof(T) * 8) - 1, fixed_dims>;
@@ -197,6 +197,14 @@ struct Graph {
             delete[] edges_start;
         }
         delete[] degrees_start;
+
+        //the entry points follow the edges, if they were saved
+        indexType num_entries;
+        if (reader.read((char *) (&num_entries), sizeof(indexType))) {
+            entries = parlay::sequence<indexType>(num_entries);
+            reader.read((char *) entries.begin(), sizeof(indexType) * num_entries);
+            std::cout << "Detected " << num_entries << " entry points" << std::endl;
+        }
     }
 
     void save(char *oFile) {
@@ -226,6 +234,11 @@ struct Graph {
             writer.write((char *) data.begin(), data.size() * sizeof(indexType));
             index = ceiling;
         }
+        if (entries.size() > 0) {
+            indexType num_entries = entries.size();
+            writer.write((char *) &num_entries, sizeof(indexType));
+            writer.write((char *) entries.begin(), num_entries * sizeof(indexType));
+        }
         writer.close();
     }
 
@@ -239,10 +252,18 @@ struct Graph {
                                     i);
     }
 
+    // The vertices searches of the graph should start from, e.g. its
+    // medoid.  They are saved after the edges, so graph files without them
+    // are still read (and give no entry points).
+    const parlay::sequence<indexType> &entry_points() const { return entries; }
+
+    void set_entry_points(parlay::sequence<indexType> pts) { entries = std::move(pts); }
+
     ~Graph() {}
 
 private:
     size_t n;
     long maxDeg;
     std::shared_ptr<indexType[]> graph;
+    parlay::sequence<indexType> entries;
 };
@@ -40,14 +40,25 @@
 
 
 float mips_distance(const float *p, const float *q, unsigned d) {
-    float result = 0;
-    for (int i = 0; i < d; i++) {
-        result += (q[i]) * (p[i]);
-    }
-    return -result;
+    return -efanna2e::dot(p, q, d);
+}
+
+// distance for points whose dimension D is known at compile time (D = 0
+// means it is only known at runtime and d is used instead)
+template<unsigned D, typename T>
+float mips_distance(const T *p, const T *q, unsigned d) {
+    return mips_distance(p, q, d);
+}
+
+template<unsigned D>
+float mips_distance(const float *p, const float *q, unsigned d) {
+    if (D == 0) return mips_distance(p, q, d);
+    return -efanna2e::fixed_dim_kernels<D>::dot(p, q, D);
 }
 
-template<typename T>
+// fixed_dims, if non-zero, is the dimension of every point, which lets the
+// distance kernel be specialized for it
+template<typename T, unsigned fixed_dims = 0>
 struct Mips_Point {
     using distanceType = float;
     //template<typename C, typename range> friend struct Quantized_Mips_Point;
@@ -66,8 +77,8 @@ struct Mips_Point {
 
     T operator[](long i) const { return *(values + i); }
 
-    float distance(const Mips_Point<T> &x) const {
-        return mips_distance(this->values, x.values, params.dims);
+    float distance(const Mips_Point &x) const {
+        return mips_distance<fixed_dims>(this->values, x.values, params.dims);
     }
 
     void prefetch() const {
@@ -83,7 +94,7 @@ struct Mips_Point {
     Mips_Point(T *values, long id, parameters params)
             : values(values), id_(id), params(params) {}
 
-    bool operator==(const Mips_Point<T> &q) const {
+    bool operator==(const Mips_Point &q) const {
         for (int i = 0; i < params.dims; i++) {
             if (values[i] != q.values[i]) {
                 return false;
@@ -92,7 +103,7 @@ struct Mips_Point {
         return true;
     }
 
-    bool same_as(const Mips_Point<T> &q) const {
+    bool same_as(const Mips_Point &q) const {
         return values == q.values;
     }
 
@@ -0,0 +1,109 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The frontier of a beam search as a bounded priority queue, as in the
+// NeighborPriorityQueue of DiskANN.  Up to capacity (id, distance) pairs
+// are kept sorted by distance (ties broken by id) with a flag marking the
+// ones that have been expanded, and a cursor at the closest unexpanded
+// one.  Inserting a candidate is a binary search and a shift of the
+// entries behind it, and the next node to expand is found by moving the
+// cursor, so a hop needs no set union or difference over the frontier and
+// the visited list.
+template<typename indexType, typename distanceType>
+struct NeighborPriorityQueue {
+    using pid = std::pair<indexType, distanceType>;
+
+    // empties the queue, keeping its memory
+    void reset(size_t capacity_) {
+        capacity = capacity_;
+        n = 0;
+        cursor = 0;
+        data.resize(capacity + 1);
+        expanded.resize(capacity + 1);
+    }
+
+    size_t size() const { return n; }
+    bool full() const { return n == capacity; }
+    const pid &operator[](size_t i) const { return data[i]; }
+    const pid *begin() const { return data.data(); }
+    const pid *end() const { return data.data() + n; }
+    distanceType furthest() const { return data[n - 1].second; }
+
+    bool has_unexpanded() const { return cursor < n; }
+
+    // inserts c unless the queue is full of closer entries or already
+    // holds it
+    void insert(pid c) {
+        if (n == capacity && !less(c, data[n - 1])) return;
+        size_t pos = std::lower_bound(data.begin(), data.begin() + n, c, less) - data.begin();
+        if (pos < n && data[pos].first == c.first) return;
+        std::copy_backward(data.begin() + pos, data.begin() + n, data.begin() + n + 1);
+        std::copy_backward(expanded.begin() + pos, expanded.begin() + n, expanded.begin() + n + 1);
+        data[pos] = c;
+        expanded[pos] = false;
+        if (n < capacity) n++;
+        if (pos < cursor) cursor = pos;
+    }
+
+    // returns the closest unexpanded entry, marking it expanded
+    pid expand_next() {
+        pid c = data[cursor];
+        expanded[cursor] = true;
+        while (cursor < n && expanded[cursor]) cursor++;
+        return c;
+    }
+
+    // calls f on up to m of the closest unexpanded entries, the ones that
+    // are likely to be expanded next
+    template<typename F>
+    void peek_unexpanded(size_t m, F f) const {
+        for (size_t i = cursor; i < n && m > 0; i++)
+            if (!expanded[i]) {
+                f(data[i]);
+                m--;
+            }
+    }
+
+    // drops all but the first m entries
+    void truncate(size_t m) {
+        n = std::min(n, m);
+        cursor = std::min(cursor, n);
+    }
+
+    static bool less(const pid &a, const pid &b) {
+        return a.second < b.second || (a.second == b.second && a.first < b.first);
+    }
+
+private:
+    size_t capacity = 0;
+    size_t n = 0;
+    size_t cursor = 0;
+    std::vector<pid> data;
+    std::vector<uint8_t> expanded;
+};
@@ -25,6 +25,8 @@
 #include <sys/mman.h>
 #include <algorithm>
 #include <iostream>
+#include <fstream>
+#include <type_traits>
 
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
@@ -46,6 +48,41 @@ long dim_round_up(long dim, long tp_size) {
     else return ((qt + 1) * 64) / tp_size;
 }
 
+// reads the dimension from the header of a .bin file without loading it
+long bin_file_dimension(char *filename) {
+    if (filename == NULL) return 0;
+    std::ifstream reader(filename);
+    assert(reader.is_open());
+    unsigned int header[2];
+    reader.read((char *) header, 2 * sizeof(unsigned int));
+    return header[1];
+}
+
+// Calls f with std::integral_constant<unsigned, D> where D is dims if it is
+// one of the dimensions we have specialized distance kernels for, and 0
+// (meaning the dimension is only known at runtime) otherwise.
+template<typename F>
+void dispatch_fixed_dims(long dims, F f) {
+    switch (dims) {
+        case 96: f(std::integral_constant<unsigned, 96>()); break;
+        case 100: f(std::integral_constant<unsigned, 100>()); break;
+        case 128: f(std::integral_constant<unsigned, 128>()); break;
+        case 200: f(std::integral_constant<unsigned, 200>()); break;
+        case 384: f(std::integral_constant<unsigned, 384>()); break;
+        case 768: f(std::integral_constant<unsigned, 768>()); break;
+        case 960: f(std::integral_constant<unsigned, 960>()); break;
+        default: f(std::integral_constant<unsigned, 0>()); break;
+    }
+}
+
+// Point types that define a static cached_norm(values, dims) get it
+// computed once for every vector of a range when the range is built, and
+// find the results in params.norms, indexed by point id.
+template<typename Point, typename = void>
+struct caches_norms : std::false_type {};
+
+template<typename Point>
+struct caches_norms<Point, std::void_t<decltype(&Point::cached_norm)>> : std::true_type {};
 
 template<typename T_, class Point_>
 struct PointRange {
@@ -72,6 +109,7 @@ struct PointRange {
         parlay::parallel_for(0, n, [&](long i) {
             Point::translate_point(vptr + i * aligned_dims, pr[i], params);
         });
+        compute_norms();
     }
 
     template<typename PR>
@@ -119,6 +157,7 @@ struct PointRange {
             delete[] data_start;
             index = ceiling;
         }
+        compute_norms();
     }
 
     size_t size() const { return n; }
@@ -133,10 +172,40 @@ struct PointRange {
         return Point(values.get() + i * aligned_dims, i, params);
     }
 
+    // Computes the distance from query to each of the n points in ids,
+    // writing them to out.  The query vector stays hot while the points are
+    // streamed, each prefetched lookahead points ahead of the one being
+    // scored (or all of them up front, if lookahead is 0).
+    template<typename indexType>
+    void batch_distance(const Point &query, const indexType *ids, size_t n,
+                        typename Point::distanceType *out, size_t lookahead = 2) const {
+        if (lookahead == 0) lookahead = n;
+        auto point = [&](indexType id) {
+            return Point(values.get() + (long) id * aligned_dims, id, params);
+        };
+        for (size_t i = 0; i < std::min(n, lookahead); i++)
+            point(ids[i]).prefetch();
+        for (size_t i = 0; i < n; i++) {
+            if (i + lookahead < n) point(ids[i + lookahead]).prefetch();
+            out[i] = point(ids[i]).distance(query);
+        }
+    }
+
     parameters params;
 
 private:
+    void compute_norms() {
+        if constexpr (caches_norms<Point>::value) {
+            norms = std::shared_ptr<float[]>(new float[n]);
+            parlay::parallel_for(0, n, [&](long i) {
+                norms[i] = Point::cached_norm(values.get() + i * aligned_dims, dims);
+            });
+            params.norms = norms.get();
+        }
+    }
+
     std::shared_ptr<T[]> values;
+    std::shared_ptr<float[]> norms;
     unsigned int dims;
     unsigned int aligned_dims;
     size_t n;
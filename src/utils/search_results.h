@@ -0,0 +1,75 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "parlay/primitives.h"
+#include "parlay/sequence.h"
+
+// The results of searching for the k nearest neighbors of each of n
+// queries.  The ids and distances of the neighbors of all queries are kept
+// in flat n x k tables, closest first, so that the searches write them in
+// place and callers read their distances instead of computing them again.
+// A search that finds fewer than k points leaves the rest of its row at
+// the largest id and distance.  Each search also records the vertices it
+// visited, the distances it computed and the steps it took.
+template<typename indexType, typename distanceType>
+struct SearchResults {
+    size_t n = 0;
+    size_t k = 0;
+    parlay::sequence<indexType> ids;
+    parlay::sequence<distanceType> distances;
+    parlay::sequence<size_t> visited;
+    parlay::sequence<size_t> dist_cmps;
+    parlay::sequence<size_t> hops;
+
+    SearchResults() {}
+
+    SearchResults(size_t n, size_t k)
+        : n(n), k(k),
+          ids(n * k, std::numeric_limits<indexType>::max()),
+          distances(n * k, std::numeric_limits<distanceType>::max()),
+          visited(n, 0), dist_cmps(n, 0), hops(n, 0) {}
+
+    size_t size() const { return n; }
+
+    // the row of query i
+    indexType* neighbors(size_t i) { return ids.data() + i * k; }
+    const indexType* neighbors(size_t i) const { return ids.data() + i * k; }
+    distanceType* neighbor_distances(size_t i) { return distances.data() + i * k; }
+    const distanceType* neighbor_distances(size_t i) const { return distances.data() + i * k; }
+
+    // fills the row of query i from up to k (id, distance) pairs, closest
+    // first
+    template<typename Iterator>
+    void set(size_t i, Iterator begin, Iterator end) {
+        size_t m = std::min<size_t>(k, end - begin);
+        for (size_t j = 0; j < m; j++) {
+            ids[i * k + j] = begin[j].first;
+            distances[i * k + j] = begin[j].second;
+        }
+    }
+};
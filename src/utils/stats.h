@@ -58,23 +58,37 @@ struct stats {
     stats(size_t n) {
         visited = parlay::sequence<indexType>(n, 0);
         distances = parlay::sequence<indexType>(n, 0);
+        seen_skips = parlay::sequence<indexType>(n, 0);
     }
 
     parlay::sequence<indexType> visited;
     parlay::sequence<indexType> distances;
+    // neighbors skipped because their distance had already been computed
+    parlay::sequence<indexType> seen_skips;
 
     void increment_dist(indexType i, indexType j) { distances[i] += j; }
 
     void increment_visited(indexType i, indexType j) { visited[i] += j; }
 
+    void increment_seen_skips(indexType i, indexType j) { seen_skips[i] += j; }
+
     parlay::sequence<indexType> visited_stats() { return statistics(this->visited); }
 
     parlay::sequence<indexType> dist_stats() { return statistics(this->distances); }
 
+    // the neighbors skipped as already seen, as a fraction of those plus
+    // the distances computed
+    double seen_skip_rate() {
+        double d = parlay::reduce(parlay::map(seen_skips, [](indexType x) { return (double) x; }));
+        double c = parlay::reduce(parlay::map(distances, [](indexType x) { return (double) x; }));
+        return d + c == 0 ? 0 : d / (d + c);
+    }
+
     void clear() {
         size_t n = visited.size();
         visited = parlay::sequence<indexType>(n, 0);
         distances = parlay::sequence<indexType>(n, 0);
+        seen_skips = parlay::sequence<indexType>(n, 0);
     }
 
     parlay::sequence<indexType> statistics(parlay::sequence<indexType> s) {
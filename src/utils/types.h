@@ -99,6 +99,51 @@ struct groundTruth {
     long dimension() { return dim; }
 
 };
+template<typename T>
+struct RangeGroundTruth {
+    T *coords;
+    parlay::sequence<T> offsets;
+    parlay::slice<T *, T *> sizes;
+    size_t n;
+    size_t num_matches;
+
+    RangeGroundTruth() : sizes(parlay::make_slice<T *, T *>(nullptr, nullptr)) {}
+
+    RangeGroundTruth(char *gtFile) : sizes(parlay::make_slice<T *, T *>(nullptr, nullptr)) {
+        if (gtFile == NULL) {
+            n = 0;
+            num_matches = 0;
+        } else {
+            auto [fileptr, length] = mmapStringFromFile(gtFile);
+
+            n = *((T *) fileptr);
+            num_matches = *((T *) (fileptr + sizeof(T)));
+
+            T *sizes_begin = (T *) (fileptr + 2 * sizeof(T));
+            T *sizes_end = sizes_begin + n;
+            sizes = parlay::make_slice(sizes_begin, sizes_end);
+
+            auto [offsets0, total] = parlay::scan(sizes);
+            offsets0.push_back(total);
+            offsets = offsets0;
+
+            std::cout << "Detected " << n << " points with num matches " << num_matches << std::endl;
+
+            coords = sizes_end;
+        }
+    }
+
+    parlay::slice<T *, T *> operator[](long i) {
+        T *begin = coords + offsets[i];
+        T *end = coords + offsets[i + 1];
+        return parlay::make_slice(begin, end);
+    }
+
+    size_t size() { return n; }
+
+    size_t matches() { return num_matches; }
+};
+
 
 struct BuildParams {
     long L; //vamana
@@ -106,6 +151,15 @@ struct BuildParams {
     double alpha; //vamana
     int num_passes; //vamana
     int single_batch; //vamana
+    long beam_width = 1; // vertices expanded per step of search
+    long prefetch_distance = 4; // neighbors prefetched ahead of search distances
+    long patience = 0; // stop searching once the top k is stable
+    long num_entry_points = 0; // also start searches at this many cluster centers
+    long route_entries = 0; // start each search from this many of the entry points
+    long rerank_factor = 5; // quantized searches rerank this many times k candidates
+    long rerank_patience = 0; // stop reranking once the top k is stable
+    double radius = 0; // if > 0, search for the points within this distance instead of the k nearest
+    bool beam_doubling = false; // second phase of range search doubles the beam instead of a BFS
 
     bool verbose;
 
@@ -136,6 +190,25 @@ struct QueryParams {
     double cut;
     long limit;
     long degree_limit;
+    // when searching quantized points, the closest rerank_factor * k
+    // candidates are reranked with the full vectors; if rerank_patience > 0
+    // reranking stops once that many consecutive candidates leave the top k
+    // unchanged
+    long rerank_factor = 5;
+    long rerank_patience = 0;
+    // the number of closest unvisited vertices expanded together in each
+    // step, so that their neighbors are fetched and compared as one batch
+    long beam_width = 1;
+    // how many neighbors ahead of the distance computation their vectors
+    // are prefetched; 0 prefetches all of them first
+    long prefetch_distance = 4;
+    // if patience > 0 the search stops once that many steps in a row have
+    // not changed its k closest points, instead of only once the whole
+    // frontier has been visited
+    long patience = 0;
+    // if route_entries > 0 and the graph has more entry points, the search
+    // starts from only the route_entries of them closest to the query
+    long route_entries = 0;
 
     QueryParams(long k, long Q, double cut, long limit, long dg) : k(k), beamSize(Q), cut(cut), limit(limit),
                                                                    degree_limit(dg) {}
@@ -144,4 +217,22 @@ struct QueryParams {
 
 };
 
+struct RangeParams {
+    double rad;
+    long initial_beam;
+    // if the first beam search of a range search ends with its beam full of
+    // points within the radius, search again with twice the beam instead of
+    // searching the points within the radius from them
+    bool beam_doubling = false;
+
+    RangeParams(double rad, long ib) : rad(rad), initial_beam(ib) {}
+
+    RangeParams() {}
+
+    void print() {
+        std::cout << "Beam: " << initial_beam << (beam_doubling ? " (doubling)" : " (BFS)");
+    }
+
+};
+
 #endif
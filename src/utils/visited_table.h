@@ -0,0 +1,105 @@
+// This code is part of the Problem Based Benchmark Suite (PBBS)
+// Copyright (c) 2011 Guy Blelloch and the PBBS team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights (to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "parlay/utilities.h"
+
+// The set of vertices a beam search has already seen, so that no distance
+// is computed twice.  For graphs of up to dense_limit vertices it is an
+// array with a 16-bit epoch per vertex: a vertex has been seen if its
+// entry equals the epoch of the current search, and starting a search only
+// increments the epoch (the array is cleared once every 65535 searches).
+// Larger graphs would make an array per worker too big, so they use an
+// open addressing hash set sized to the search instead, which is cleared
+// at the start of each search.
+template<typename indexType>
+struct VisitedTable {
+    static constexpr size_t dense_limit = 1ul << 24;
+
+    // empties the table for a search on a graph of n vertices that is
+    // expected to see about expected of them
+    void reset(size_t n, size_t expected) {
+        dense = n <= dense_limit;
+        if (dense) {
+            if (epochs.size() != n) {
+                epochs.assign(n, 0);
+                epoch = 0;
+            }
+            if (++epoch == 0) {
+                std::fill(epochs.begin(), epochs.end(), 0);
+                epoch = 1;
+            }
+        } else {
+            size_t size = std::max<size_t>(slots.size(), 1024);
+            while (size < 2 * expected) size *= 2;
+            slots.assign(size, empty);
+            count = 0;
+        }
+    }
+
+    // returns true if a has been seen since the last reset, and marks it
+    // as seen otherwise
+    bool test_and_set(indexType a) {
+        if (dense) {
+            if (epochs[a] == epoch) return true;
+            epochs[a] = epoch;
+            return false;
+        }
+        if (insert(a)) return true;
+        if (2 * ++count > slots.size()) grow();
+        return false;
+    }
+
+private:
+    static constexpr indexType empty = (indexType) -1;
+
+    // returns true if a was already present
+    bool insert(indexType a) {
+        size_t mask = slots.size() - 1;
+        size_t loc = parlay::hash64_2(a) & mask;
+        while (slots[loc] != empty) {
+            if (slots[loc] == a) return true;
+            loc = (loc + 1) & mask;
+        }
+        slots[loc] = a;
+        return false;
+    }
+
+    void grow() {
+        std::vector<indexType> old(2 * slots.size(), empty);
+        std::swap(old, slots);
+        for (indexType a : old)
+            if (a != empty) insert(a);
+    }
+
+    bool dense = true;
+    uint16_t epoch = 0;
+    std::vector<uint16_t> epochs;
+    size_t count = 0;
+    std::vector<indexType> slots;
+};
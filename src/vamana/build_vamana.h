@@ -31,6 +31,7 @@
 #include "../utils/NSGDist.h"
 #include "../utils/point_range.h"
 #include "../utils/graph.h"
+#include "../utils/entry_points.h"
 #include "../utils/types.h"
 #include "parlay/parallel.h"
 #include "parlay/primitives.h"
@@ -50,6 +51,7 @@ struct knn_index {
     BuildParams BP;
     std::set<indexType> delete_set;
     indexType start_point;
+    parlay::sequence<indexType> entry_points;
 
     knn_index(BuildParams &BP) : BP(BP) {}
 
@@ -59,7 +61,7 @@ struct knn_index {
     //that the new candidate set is added to the field new_nbhs instead
     //of directly replacing the out_nbh of p
     std::pair<parlay::sequence<indexType>, long>
-    robustPrune(indexType p, parlay::sequence<pid> &cand,
+    robustPrune(indexType p, const std::vector<pid> &cand,
                 GraphI &G, PR &Points, double alpha, bool add = true) {
         // add out neighbors of p to the candidate set.
         size_t out_size = G[p].size();
@@ -68,10 +70,11 @@ struct knn_index {
         for (auto x: cand) candidates.push_back(x);
 
         if (add) {
-            for (size_t i = 0; i < out_size; i++) {
-                distance_comps++;
-                candidates.push_back(std::make_pair(G[p][i], Points[G[p][i]].distance(Points[p])));
-            }
+            std::vector<distanceType> out_dists(out_size);
+            Points.batch_distance(Points[p], G[p].begin(), out_size, out_dists.data());
+            distance_comps += out_size;
+            for (size_t i = 0; i < out_size; i++)
+                candidates.push_back(std::make_pair(G[p][i], out_dists[i]));
         }
 
         // Sort the candidate set according to distance from p
@@ -88,6 +91,14 @@ struct knn_index {
 
         size_t candidate_idx = 0;
 
+        // the surviving candidates after p_star, and their distances to p_star
+        std::vector<size_t> remaining;
+        std::vector<indexType> remaining_ids;
+        std::vector<distanceType> starprime_dists;
+        remaining.reserve(candidates.size());
+        remaining_ids.reserve(candidates.size());
+        starprime_dists.reserve(candidates.size());
+
         while (new_nbhs.size() < BP.R && candidate_idx < candidates.size()) {
             // Don't need to do modifications.
             int p_star = candidates[candidate_idx].first;
@@ -98,15 +109,23 @@ struct knn_index {
 
             new_nbhs.push_back(p_star);
 
+            remaining.clear();
+            remaining_ids.clear();
             for (size_t i = candidate_idx; i < candidates.size(); i++) {
                 int p_prime = candidates[i].first;
                 if (p_prime != -1) {
-                    distance_comps++;
-                    distanceType dist_starprime = Points[p_star].distance(Points[p_prime]);
-                    distanceType dist_pprime = candidates[i].second;
-                    if (alpha * dist_starprime <= dist_pprime) {
-                        candidates[i].first = -1;
-                    }
+                    remaining.push_back(i);
+                    remaining_ids.push_back(p_prime);
+                }
+            }
+            starprime_dists.resize(remaining.size());
+            Points.batch_distance(Points[p_star], remaining_ids.data(), remaining_ids.size(),
+                                  starprime_dists.data());
+            distance_comps += remaining.size();
+            for (size_t j = 0; j < remaining.size(); j++) {
+                distanceType dist_pprime = candidates[remaining[j]].second;
+                if (alpha * starprime_dists[j] <= dist_pprime) {
+                    candidates[remaining[j]].first = -1;
                 }
             }
         }
@@ -121,13 +140,13 @@ struct knn_index {
     robustPrune(indexType p, parlay::sequence<indexType> candidates,
                 GraphI &G, PR &Points, double alpha, bool add = true) {
 
-        parlay::sequence<pid> cc;
-        long distance_comps = 0;
+        std::vector<pid> cc;
+        long distance_comps = candidates.size();
         cc.reserve(candidates.size()); // + size_of(p->out_nbh));
-        for (size_t i = 0; i < candidates.size(); ++i) {
-            distance_comps++;
-            cc.push_back(std::make_pair(candidates[i], Points[candidates[i]].distance(Points[p])));
-        }
+        std::vector<distanceType> dists(candidates.size());
+        Points.batch_distance(Points[p], candidates.begin(), candidates.size(), dists.data());
+        for (size_t i = 0; i < candidates.size(); ++i)
+            cc.push_back(std::make_pair(candidates[i], dists[i]));
         auto [ngh_seq, dc] = robustPrune(p, cc, G, Points, alpha, add);
         return std::pair(ngh_seq, dc + distance_comps);
     }
@@ -141,11 +160,19 @@ struct knn_index {
             if (a.count(ngh[i]) == 0) candidates.push_back(ngh[i]);
     }
 
-    void set_start() { start_point = 0; }
+    // Searches start from an approximate medoid of the points, and if
+    // BP.num_entry_points > 0 also from the points closest to the centers of
+    // that many clusters of them.
+    void set_start(PR &Points) {
+        start_point = approximate_medoid<indexType>(Points);
+        entry_points = {start_point};
+        for (indexType p : diverse_entry_points<indexType>(Points, BP.num_entry_points))
+            if (p != start_point) entry_points.push_back(p);
+    }
 
     void build_index(GraphI &G, PR &Points, stats<indexType> &BuildStats, bool sort_neighbors = true) {
         std::cout << "Building graph..." << std::endl;
-        set_start();
+        set_start(Points);
         parlay::sequence<indexType> inserts = parlay::tabulate(Points.size(), [&](size_t i) {
             return static_cast<indexType>(i);
         });
@@ -186,6 +213,7 @@ struct knn_index {
                 G[i].sort(less);
             });
         }
+        G.set_entry_points(entry_points);
     }
 
     void batch_insert(parlay::sequence<indexType> &inserts,
@@ -226,6 +254,8 @@ struct knn_index {
         t_beam.stop();
         t_bidirect.stop();
         t_prune.stop();
+        parlay::sequence<indexType> start_points = entry_points;
+        SearchScratchPool<indexType, distanceType> scratch_pool;
         while (count < m) {
             size_t floor;
             size_t ceiling;
@@ -253,13 +283,19 @@ struct knn_index {
 
             parlay::parallel_for(floor, ceiling, [&](size_t i) {
                 size_t index = shuffled_inserts[i];
-                int sp = BP.single_batch ? i : start_point;
                 QueryParams QP((long) 0, BP.L, (double) 0.0, (long) Points.size(), (long) G.max_degree());
-                auto [beam_visited, bs_distance_comps] =
-                        beam_search<Point, PointRange, indexType>(Points[index], G, Points, sp, QP);
-                auto [beam, visited] = beam_visited;
+                auto &scratch = scratch_pool.get();
+                size_t bs_distance_comps;
+                if (BP.single_batch)
+                    bs_distance_comps = beam_search<Point, PointRange, indexType>(
+                            Points[index], G, Points, parlay::sequence<indexType>(1, i), QP, scratch);
+                else
+                    bs_distance_comps = beam_search<Point, PointRange, indexType>(
+                            Points[index], G, Points, start_points, QP, scratch);
+                auto &visited = scratch.visited;
                 BuildStats.increment_dist(index, bs_distance_comps);
                 BuildStats.increment_visited(index, visited.size());
+                BuildStats.increment_seen_skips(index, scratch.seen_skips);
 
                 long rp_distance_comps;
                 std::tie(new_out_[i - floor], rp_distance_comps) = robustPrune(index, visited, G, Points, alpha);
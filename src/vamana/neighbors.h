@@ -25,6 +25,7 @@
 #include "../utils/NSGDist.h"
 #include "../utils/beamSearch.h"
 #include "../utils/check_nn_recall.h"
+#include "../utils/check_range_recall.h"
 #include "../utils/parse_results.h"
 #include "../utils/mips_point.h"
 #include "../utils/euclidian_point.h"
@@ -50,7 +51,8 @@ void ANN_build_index_(Graph<indexType> &G, BuildParams &BP, PointRange &Points)
     I.build_index(G, Points, BuildStats);
     start_point = I.get_start();
     idx_time = t.next_time();
-    std::cout << "start index = " << start_point << std::endl;
+    std::cout << "start index = " << start_point << " ("
+              << G.entry_points().size() << " entry points)" << std::endl;
 
     std::string name = "Vamana";
     std::string params =
@@ -58,7 +60,7 @@ void ANN_build_index_(Graph<indexType> &G, BuildParams &BP, PointRange &Points)
     auto [avg_deg, max_deg] = graph_stats_(G);
     auto vv = BuildStats.visited_stats();
     std::cout << "Average visited: " << vv[0] << ", Tail visited: " << vv[1]
-              << std::endl;
+              << ", Seen-skip rate: " << BuildStats.seen_skip_rate() << std::endl;
     Graph_ G_(name, params, G.size(), avg_deg, max_deg, idx_time);
     G_.print();
 
@@ -83,9 +85,11 @@ void ANN_search_(Graph<indexType> &G, long k, BuildParams &BP,
 
     double idx_time = 0;
     indexType start_point = 0;
+    if (G.entry_points().size() > 0) start_point = G.entry_points()[0];
     // declare two array, visited and distances
     stats<unsigned int> BuildStats(G.size());
-    std::cout << "start index = " << start_point << std::endl;
+    std::cout << "start index = " << start_point << " ("
+              << G.entry_points().size() << " entry points)" << std::endl;
 
     std::string name = "Vamana";
     std::string params =
@@ -104,7 +108,10 @@ void ANN_search_(Graph<indexType> &G, long k, BuildParams &BP,
     search_and_parse<Point, PointRange, QPointRange, indexType>(G_, G, Points, Query_Points,
                                                                 Q_Points, Q_Query_Points, GT,
                                                                 res_file, k, start_point,
-                                                                BP.verbose);
+                                                                BP.verbose, BP.rerank_factor,
+                                                                BP.rerank_patience, BP.beam_width,
+                                                                BP.prefetch_distance, BP.patience,
+                                                                BP.route_entries);
 
 }
 
@@ -117,3 +124,35 @@ void ANN_search(PointRange_ &Points, Graph<indexType> &G, BuildParams &BP,
                                                             Query_Points, Query_Points, GT, res_file,
                                                             Points, Points);
 }
+
+// Searches the quantized points first and reranks the candidates with
+// Points, for graphs built with -quantize_build.
+template<typename Point, typename PointRange_, typename QPointRange, typename indexType>
+void ANN_quantized_search(PointRange_ &Points, QPointRange &Q_Points, Graph<indexType> &G,
+                          BuildParams &BP, PointRange_ &Query_Points,
+                          QPointRange &Q_Query_Points, long k,
+                          groundTruth<indexType> GT, char *res_file) {
+
+    ANN_search_<Point, PointRange_, QPointRange, indexType>(G, k, BP,
+                                                            Query_Points, Q_Query_Points, GT, res_file,
+                                                            Points, Q_Points);
+}
+
+// Searches for the points within BP.radius of each query, from every
+// entry point of G, for each initial beam of range_search_wrapper.
+template<typename Point, typename PointRange_, typename indexType>
+void ANN_range_search(PointRange_ &Points, Graph<indexType> &G, BuildParams &BP,
+                      PointRange_ &Query_Points, RangeGroundTruth<indexType> &GT) {
+    parlay::sequence<indexType> start_points = G.entry_points();
+    if (start_points.size() == 0) start_points = {0};
+    std::cout << "range search with radius " << BP.radius << " from "
+              << start_points.size() << " entry points" << std::endl;
+    range_search_wrapper<Point, PointRange_, indexType>(G, Points, Query_Points, GT, BP.radius,
+                                                        start_points, BP.beam_doubling);
+}
+
+// where the quantization parameters of a graph built with -quantize_build
+// are kept
+std::string quantization_file(const char *graph_file) {
+    return std::string(graph_file) + ".qparams";
+}